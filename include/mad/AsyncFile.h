@@ -0,0 +1,478 @@
+/*
+ * AsyncFile.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: mad
+ */
+
+#ifndef INCLUDE_ASYNCFILE_H_
+#define INCLUDE_ASYNCFILE_H_
+
+/*
+ * Optional C++20 coroutine interface, only available when compiling with coroutine support.
+ */
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+
+#define MAD_HAVE_COROUTINES 1
+
+#include <mad/DirectFile.h>
+
+#include <mutex>
+#include <deque>
+#include <vector>
+#include <utility>
+#include <optional>
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+#include <coroutine>
+#include <functional>
+
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+
+namespace mad {
+
+/*
+ * Lazily started coroutine returning `T`, runs when awaited.
+ */
+template<typename T = void>
+class Task;
+
+namespace detail {
+
+struct task_promise_base
+{
+	std::coroutine_handle<> continuation;
+	std::exception_ptr error;
+
+	struct final_awaiter {
+		bool await_ready() noexcept {
+			return false;
+		}
+		template<typename P>
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<P> handle) noexcept {
+			const auto next = handle.promise().continuation;
+			return next ? next : std::noop_coroutine();
+		}
+		void await_resume() noexcept {}
+	};
+
+	std::suspend_always initial_suspend() noexcept {
+		return {};
+	}
+
+	final_awaiter final_suspend() noexcept {
+		return {};
+	}
+
+	void unhandled_exception() noexcept {
+		error = std::current_exception();
+	}
+};
+
+template<typename T>
+struct task_promise : task_promise_base
+{
+	std::optional<T> value;
+
+	Task<T> get_return_object() noexcept;
+
+	void return_value(T result) {
+		value = std::move(result);
+	}
+
+	T get() {
+		if(error) {
+			std::rethrow_exception(error);
+		}
+		return std::move(*value);
+	}
+};
+
+template<>
+struct task_promise<void> : task_promise_base
+{
+	Task<void> get_return_object() noexcept;
+
+	void return_void() noexcept {}
+
+	void get() {
+		if(error) {
+			std::rethrow_exception(error);
+		}
+	}
+};
+
+} // detail
+
+template<typename T>
+class Task {
+public:
+	typedef detail::task_promise<T> promise_type;
+
+	Task() = default;
+
+	explicit Task(std::coroutine_handle<promise_type> handle)
+		:	handle(handle)
+	{
+	}
+
+	Task(Task&& other) noexcept
+		:	handle(std::exchange(other.handle, nullptr))
+	{
+	}
+
+	Task& operator=(Task&& other) noexcept {
+		std::swap(handle, other.handle);
+		return *this;
+	}
+
+	Task(const Task&) = delete;
+	Task& operator=(const Task&) = delete;
+
+	~Task() {
+		if(handle) {
+			handle.destroy();
+		}
+	}
+
+	bool await_ready() const noexcept {
+		return !handle || handle.done();
+	}
+
+	std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) noexcept {
+		handle.promise().continuation = caller;
+		return handle;
+	}
+
+	T await_resume() {
+		return handle.promise().get();
+	}
+
+private:
+	std::coroutine_handle<promise_type> handle;
+
+};
+
+namespace detail {
+
+template<typename T>
+Task<T> task_promise<T>::get_return_object() noexcept {
+	return Task<T>(std::coroutine_handle<task_promise<T>>::from_promise(*this));
+}
+
+inline
+Task<void> task_promise<void>::get_return_object() noexcept {
+	return Task<void>(std::coroutine_handle<task_promise<void>>::from_promise(*this));
+}
+
+} // detail
+
+/*
+ * Completion reactor: resumes coroutines whose I/O finished, on the thread calling run() / poll().
+ * Waits on registered fds (such as DirectFile::get_completion_fd()) plus an eventfd for post(), no extra threads.
+ */
+class Reactor {
+public:
+	Reactor()
+	{
+		wake_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if(wake_fd < 0) {
+			throw std::runtime_error("eventfd() failed with: " + std::string(std::strerror(errno)));
+		}
+	}
+
+	~Reactor() {
+		::close(wake_fd);
+	}
+
+	Reactor(const Reactor&) = delete;
+	Reactor& operator=(const Reactor&) = delete;
+
+	/*
+	 * Start a top-level coroutine, which runs until its first suspension right away.
+	 * Note: call from reactor thread
+	 */
+	void spawn(Task<void> task)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			num_active++;
+		}
+		run_detached(std::move(task));
+	}
+
+	/*
+	 * Queue coroutine to be resumed by the reactor.
+	 * Note: thread-safe
+	 */
+	void post(std::coroutine_handle<> handle)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			ready.push_back(handle);
+		}
+		const uint64_t one = 1;
+		if(::write(wake_fd, &one, sizeof(one)) < 0) {
+			// can only fail with EAGAIN on counter overflow, in which case it's still readable
+		}
+	}
+
+	/*
+	 * Call `on_ready` from the reactor thread whenever `fd` is readable.
+	 * Note: call from reactor thread
+	 */
+	void add_source(const int fd, std::function<void()> on_ready)
+	{
+		sources.push_back(std::make_pair(fd, std::move(on_ready)));
+	}
+
+	// Note: call from reactor thread
+	void remove_source(const int fd)
+	{
+		sources.erase(std::remove_if(sources.begin(), sources.end(),
+				[fd](const std::pair<int, std::function<void()>>& entry) { return entry.first == fd; }),
+			sources.end());
+	}
+
+	/*
+	 * Process ready sources and resume all ready coroutines without blocking, returns number resumed.
+	 */
+	size_t poll()
+	{
+		wait(0);
+		return resume_ready();
+	}
+
+	/*
+	 * Process completions until all spawned coroutines finished.
+	 * Re-throws the first exception that escaped a spawned coroutine.
+	 */
+	void run()
+	{
+		while(true) {
+			bool idle = false;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if(ready.empty() && !num_active) {
+					break;
+				}
+				idle = ready.empty();
+			}
+			wait(idle ? -1 : 0);
+			resume_ready();
+		}
+		if(error) {
+			std::rethrow_exception(std::exchange(error, nullptr));
+		}
+	}
+
+	size_t get_num_active() {
+		std::lock_guard<std::mutex> lock(mutex);
+		return num_active;
+	}
+
+private:
+	struct detached_t {
+		struct promise_type {
+			detached_t get_return_object() noexcept {
+				return {};
+			}
+			std::suspend_never initial_suspend() noexcept {
+				return {};
+			}
+			std::suspend_never final_suspend() noexcept {
+				return {};
+			}
+			void return_void() noexcept {}
+			void unhandled_exception() noexcept {
+				std::terminate();
+			}
+		};
+	};
+
+	detached_t run_detached(Task<void> task)
+	{
+		try {
+			co_await task;
+		} catch(...) {
+			if(!error) {
+				error = std::current_exception();
+			}
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		num_active--;
+	}
+
+	// wait up to `timeout_ms` (-1 = forever) for any fd, then call callbacks of ready sources
+	void wait(const int timeout_ms)
+	{
+		std::vector<pollfd> fds(1 + sources.size());
+		fds[0] = {wake_fd, POLLIN, 0};
+		for(size_t i = 0; i < sources.size(); ++i) {
+			fds[1 + i] = {sources[i].first, POLLIN, 0};
+		}
+		if(::poll(fds.data(), fds.size(), timeout_ms) < 0) {
+			if(errno == EINTR) {
+				return;
+			}
+			throw std::runtime_error("poll() failed with: " + std::string(std::strerror(errno)));
+		}
+		if(fds[0].revents) {
+			uint64_t count = 0;
+			if(::read(wake_fd, &count, sizeof(count)) < 0) {
+				// EAGAIN if somebody else was faster
+			}
+		}
+		const auto list = sources;		// callbacks may add or remove sources
+		for(size_t i = 0; i < list.size(); ++i) {
+			if(fds[1 + i].revents) {
+				list[i].second();
+			}
+		}
+	}
+
+	size_t resume_ready()
+	{
+		std::deque<std::coroutine_handle<>> list;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			list.swap(ready);
+		}
+		for(auto handle : list) {
+			handle.resume();
+		}
+		return list.size();
+	}
+
+private:
+	std::mutex mutex;
+	std::deque<std::coroutine_handle<>> ready;
+	size_t num_active = 0;
+
+	int wake_fd = -1;
+	std::vector<std::pair<int, std::function<void()>>> sources;		// only accessed from reactor thread
+	std::exception_ptr error;		// only accessed from reactor thread
+
+};
+
+/*
+ * Awaitable write(), read() and flush() on a DirectFile.
+ * Operations are submitted via DirectFile::submit_*() (executed by its I/O thread pool, see `num_io_threads`),
+ * the awaiting coroutine is resumed by `reactor` once the completion is reaped.
+ * Any number of operations may be in flight at once.
+ * Note: takes over the file's completions, don't call DirectFile::reap_completions() elsewhere
+ * Note: create and destroy on reactor thread
+ */
+class AsyncFile {
+public:
+	AsyncFile(DirectFile& file, Reactor& reactor)
+		:	file(file),
+			reactor(reactor),
+			completion_fd(file.get_completion_fd())
+	{
+		reactor.add_source(completion_fd, [this]() {
+			for(auto& done : this->file.reap_completions()) {
+				const auto op = (op_t*)done.user_data;
+				op->error = done.error;
+				this->reactor.post(op->handle);
+			}
+		});
+	}
+
+	~AsyncFile() {
+		reactor.remove_source(completion_fd);
+	}
+
+	AsyncFile(const AsyncFile&) = delete;
+	AsyncFile& operator=(const AsyncFile&) = delete;
+
+	/*
+	 * Awaitable for one operation, see write(), read() and flush().
+	 */
+	struct op_t
+	{
+		DirectFile* file = nullptr;
+		DirectFile::async_op_e op = DirectFile::ASYNC_WRITE;
+		void* data = nullptr;
+		size_t length = 0;
+		uint64_t offset = 0;
+		std::coroutine_handle<> handle;
+		std::exception_ptr error;
+
+		op_t(DirectFile* file, const DirectFile::async_op_e op, void* data = nullptr, const size_t length = 0, const uint64_t offset = 0)
+			:	file(file), op(op), data(data), length(length), offset(offset)
+		{
+		}
+
+		bool await_ready() const noexcept {
+			return false;
+		}
+
+		void await_suspend(std::coroutine_handle<> caller)
+		{
+			handle = caller;
+			const auto user_data = uint64_t(this);
+			switch(op) {
+				case DirectFile::ASYNC_WRITE:
+					file->submit_write(data, length, offset, user_data);
+					break;
+				case DirectFile::ASYNC_READ:
+					file->submit_read(data, length, offset, user_data);
+					break;
+				case DirectFile::ASYNC_FLUSH:
+					file->submit_flush(user_data);
+					break;
+			}
+		}
+
+		void await_resume() {
+			if(error) {
+				std::rethrow_exception(error);
+			}
+		}
+	};
+
+	/*
+	 * Same as DirectFile::write(), `data` needs to stay valid until resumed.
+	 */
+	op_t write(const void* data, const size_t length, const uint64_t offset)
+	{
+		return op_t(&file, DirectFile::ASYNC_WRITE, const_cast<void*>(data), length, offset);
+	}
+
+	/*
+	 * Same as DirectFile::read().
+	 */
+	op_t read(void* data, const size_t length, const uint64_t offset)
+	{
+		return op_t(&file, DirectFile::ASYNC_READ, data, length, offset);
+	}
+
+	/*
+	 * Same as DirectFile::flush().
+	 */
+	op_t flush()
+	{
+		return op_t(&file, DirectFile::ASYNC_FLUSH);
+	}
+
+	DirectFile& get_file() {
+		return file;
+	}
+
+private:
+	DirectFile& file;
+	Reactor& reactor;
+	const int completion_fd;
+
+};
+
+} // mad
+
+#endif // __cpp_impl_coroutine
+
+#endif /* INCLUDE_ASYNCFILE_H_ */
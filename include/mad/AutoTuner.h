@@ -0,0 +1,97 @@
+/*
+ * AutoTuner.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: mad
+ */
+
+#ifndef INCLUDE_AUTOTUNER_H_
+#define INCLUDE_AUTOTUNER_H_
+
+#include <algorithm>
+
+#include <cstdint>
+#include <cstddef>
+
+
+namespace mad {
+
+/*
+ * Hill climbing over a power of two sized parameter, maximizing the measured throughput.
+ * Samples are accumulated until `epoch_bytes`, then the value is doubled or halved,
+ * reversing direction whenever the last step made things worse.
+ * Note: NOT thread-safe
+ */
+class AutoTuner {
+public:
+	AutoTuner(const size_t value, const size_t min_value, const size_t max_value, const uint64_t epoch_bytes)
+		:	min_value(min_value),
+			max_value(std::max(min_value, max_value)),
+			epoch_bytes(epoch_bytes)
+	{
+		this->value = std::min(std::max(value, min_value), this->max_value);
+	}
+
+	/*
+	 * Add a measurement of `bytes` processed in `time_ns`.
+	 * Returns true when the value was changed.
+	 */
+	bool add_sample(const uint64_t bytes, const uint64_t time_ns)
+	{
+		sum_bytes += bytes;
+		sum_time_ns += time_ns;
+
+		if(sum_bytes < epoch_bytes || sum_time_ns == 0) {
+			return false;
+		}
+		const auto throughput = double(sum_bytes) / sum_time_ns;
+		sum_bytes = 0;
+		sum_time_ns = 0;
+
+		if(throughput < last_throughput * (1 - tolerance)) {
+			direction = -direction;
+		}
+		last_throughput = throughput;
+
+		const auto prev = value;
+		if(direction > 0) {
+			value = std::min(value * 2, max_value);
+		} else {
+			value = std::max(value / 2, min_value);
+		}
+		if(value == prev) {
+			direction = -direction;		// hit a bound
+		}
+		return value != prev;
+	}
+
+	size_t get_value() const {
+		return value;
+	}
+
+	// throughput of last epoch in bytes / sec
+	double get_throughput() const {
+		return last_throughput * 1e9;
+	}
+
+	// relative drop in throughput that is considered noise
+	double tolerance = 0.02;
+
+private:
+	const size_t min_value;
+	const size_t max_value;
+	const uint64_t epoch_bytes;
+
+	size_t value = 0;
+	int direction = 1;
+
+	uint64_t sum_bytes = 0;
+	uint64_t sum_time_ns = 0;
+	double last_throughput = 0;
+
+};
+
+
+} // mad
+
+#endif /* INCLUDE_AUTOTUNER_H_ */
@@ -8,18 +8,39 @@
 #ifndef INCLUDE_DIRECTFILE_H_
 #define INCLUDE_DIRECTFILE_H_
 
+#include <mad/AutoTuner.h>
+#include <mad/IOTrace.h>
+#include <mad/Probes.h>
+#include <mad/RateLimiter.h>
+#include <mad/ReadCache.h>
+#include <mad/ThreadPool.h>
+#include <mad/WriteProfiler.h>
+
 #include <map>
+#include <deque>
+#include <unordered_map>
+#include <atomic>
+#include <memory>
 #include <mutex>
+#include <new>
+#include <utility>
 #include <string>
 #include <vector>
 #include <stdexcept>
 #include <algorithm>
+#include <chrono>
+#include <future>
+#include <exception>
+#include <condition_variable>
 
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 
 #include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 
@@ -35,6 +56,17 @@ public:
 	{
 		uint8_t* data = nullptr;
 
+		// access pattern of read() calls, see check_read_ahead()
+		struct stream_t {
+			uint64_t last_offset = 0;
+			uint64_t last_end = 0;
+			int64_t stride = 0;			// for non-sequential streams
+			bool sequential = false;
+			int count = 0;				// number of consecutive matches
+			uint64_t window = 0;		// current read-ahead size [bytes]
+			uint64_t ahead = 0;			// read-ahead issued up to this offset
+		} stream;
+
 		buffer_t() = default;
 		buffer_t(const buffer_t&) = delete;
 		buffer_t& operator=(const buffer_t&) = delete;
@@ -47,14 +79,186 @@ public:
 		}
 	};
 
+	/*
+	 * Page aligned heap memory, for zero-copy read() (see read_impl()).
+	 * Size is rounded up to a multiple of `alignment`.
+	 */
+	struct aligned_buffer_t
+	{
+		aligned_buffer_t() = default;
+
+		aligned_buffer_t(const size_t size, const size_t alignment = 4096)
+			:	size_(size)
+		{
+			data_ = (uint8_t*)::aligned_alloc(alignment, ((size + alignment - 1) / alignment) * alignment);
+			if(!data_ && size) {
+				throw std::bad_alloc();
+			}
+		}
+
+		aligned_buffer_t(aligned_buffer_t&& other) {
+			*this = std::move(other);
+		}
+
+		aligned_buffer_t(const aligned_buffer_t&) = delete;
+		aligned_buffer_t& operator=(const aligned_buffer_t&) = delete;
+
+		aligned_buffer_t& operator=(aligned_buffer_t&& other) {
+			std::swap(data_, other.data_);
+			std::swap(size_, other.size_);
+			return *this;
+		}
+
+		~aligned_buffer_t() {
+			::free(data_);
+		}
+
+		uint8_t* data() const {
+			return data_;
+		}
+
+		size_t size() const {
+			return size_;
+		}
+
+	private:
+		uint8_t* data_ = nullptr;
+		size_t size_ = 0;
+	};
+
+	/*
+	 * Read-only view returned by read_view(), the underlying buffer is kept alive
+	 * until the last copy of the view is dropped (or released).
+	 */
+	struct view_t
+	{
+		const uint8_t* data = nullptr;
+		size_t length = 0;
+		std::shared_ptr<void> handle;
+
+		void release() {
+			handle.reset();
+			data = nullptr;
+			length = 0;
+		}
+	};
+
+	/*
+	 * One request for read_batch(), `data` needs to hold `length` bytes.
+	 */
+	struct read_request_t
+	{
+		uint64_t offset = 0;
+		size_t length = 0;
+		void* data = nullptr;
+	};
+
+	/*
+	 * Access pattern hints, see advise().
+	 */
+	enum advice_e {
+		ADVISE_NORMAL,			// default, detect pattern automatically
+		ADVISE_SEQUENTIAL,		// read ahead right away, with max window
+		ADVISE_RANDOM,			// no read-ahead
+		ADVISE_WILLNEED,		// prefetch into read cache
+		ADVISE_DONTNEED,		// drop from read cache
+	};
+
+	enum async_op_e {
+		ASYNC_WRITE,
+		ASYNC_READ,
+		ASYNC_FLUSH,
+	};
+
+	/*
+	 * Finished asynchronous operation, see reap_completions().
+	 */
+	struct completion_t
+	{
+		uint64_t user_data = 0;			// as passed to submit_*()
+		async_op_e op = ASYNC_WRITE;
+		uint64_t offset = 0;
+		size_t length = 0;
+		std::exception_ptr error;		// null on success
+
+		bool ok() const {
+			return !error;
+		}
+	};
+
+	enum io_mode_e {
+		IO_MODE_DIRECT,			// O_DIRECT
+		IO_MODE_BUFFERED,		// fallback when O_DIRECT is not supported, see `write_behind_bytes`
+	};
+
+	/*
+	 * Performance counters, see get_stats().
+	 */
+	struct stats_t
+	{
+		uint64_t num_pwrite = 0;			// aligned pwrite() calls in write()
+		uint64_t num_pwrite_flush = 0;		// page writes during flush
+		uint64_t num_pread = 0;				// page reads for read-modify-write
+		uint64_t num_flush = 0;				// non-empty cache flushes
+		uint64_t num_lock_wait = 0;			// contended lock acquisitions
+		uint64_t lock_wait_ns = 0;			// total time spent waiting for the lock
+		uint64_t bytes_direct = 0;			// bytes written via aligned path
+		uint64_t bytes_cached = 0;			// bytes copied into page cache
+		uint64_t num_read = 0;				// device reads for read() / read_batch()
+		uint64_t bytes_read = 0;			// bytes read from device
+		uint64_t bytes_hole = 0;			// bytes zero filled without I/O (see sparse_read)
+		uint64_t num_write_behind = 0;		// write-behind cycles in buffered mode
+		uint64_t num_stream_emit = 0;		// prefix write outs in stream mode
+		uint64_t num_stream_wait = 0;		// waits for space in stream mode
+		uint64_t num_write_deferred = 0;	// try_write() calls handed to the I/O thread pool
+		uint64_t num_throttled = 0;			// device writes delayed by rate limit
+		uint64_t throttle_ns = 0;			// total time delayed by rate limit
+
+		io_mode_e io_mode = IO_MODE_DIRECT;
+		uint64_t read_cache_hit = 0;		// pages served from read cache
+		uint64_t read_cache_miss = 0;		// pages not found in read cache
+		uint64_t num_read_ahead = 0;		// asynchronous device reads into read cache
+		uint64_t bytes_read_ahead = 0;		// bytes read ahead
+
+		size_t chunk_size = 0;				// current max size of aligned pwrite()
+		size_t auto_flush_bytes = 0;		// current auto flush threshold
+
+		uint64_t num_syscalls() const {
+			return num_pwrite + num_pwrite_flush + num_pread + num_read + num_read_ahead;
+		}
+	};
+
 	// enable to flush directly
 	bool sequential_write = false;
 
 	// auto flush after buffering number of bytes (0 = disable)
 	size_t auto_flush_bytes = 4 * 1024 * 1024;
 
+	// optional recorder for write() and flush() calls, see IOTrace::detail (not owned)
+	IOTrace* trace = nullptr;
+
+	// optional write pattern profiler, prints summary on close() (not owned)
+	WriteProfiler* profiler = nullptr;
+
+	// number of background threads for parallel I/O (pool is created on first use)
+	int num_io_threads = 4;
+
+	// stream mode: max time to wait for a gap to be written, see enable_stream()
+	int stream_timeout_ms = 100;
+
+	// max read-ahead for sequential / strided read() streams, requires read cache (0 = disable)
+	size_t max_read_ahead = 1024 * 1024;
+
+	// enable to skip holes of sparse files when reading (via SEEK_DATA / SEEK_HOLE), holes read as zero
+	bool sparse_read = false;
+
+	// Buffered mode only: start write-out after this many bytes written, then wait for the previous
+	// write-out and drop it from the page cache, to avoid filling it with our data (0 = disable).
+	size_t write_behind_bytes = 8 * 1024 * 1024;
+
 	/*
 	 * Note: read_flag needs to be true if file has existing content that needs to be preserved!
+	 * Note: write_flag = false opens the file read-only (O_RDONLY), reads then bypass the write cache and lock.
 	 */
 	DirectFile(	const std::string& file_path, bool read_flag, bool write_flag, bool create_flag = false,
 				int log_page_size = 12, size_t buffer_size = 1024 * 1024)
@@ -69,7 +273,7 @@ public:
 		if(write_flag) {
 			flags |= O_RDWR;
 		} else {
-			flags |= O_WRONLY;
+			flags |= O_RDONLY;
 		}
 		if(create_flag) {
 			flags |= O_CREAT;
@@ -87,8 +291,112 @@ public:
 		}
 	}
 
-	~DirectFile() {
+	virtual ~DirectFile() {
 		close();
+
+		if(completion_fd >= 0) {
+			::close(completion_fd);
+		}
+
+		if(read_cache) {
+			read_cache->clear(free_pages);
+		}
+		for(auto page : free_pages) {
+			::free(page);
+		}
+		for(auto buffer : free_views) {
+			::free(buffer);
+		}
+	}
+
+	/*
+	 * Enable runtime adaption of the aligned write chunk size (up to `buffer_size`) and `auto_flush_bytes`,
+	 * by hill climbing on measured throughput. The chosen values are reported via get_stats().
+	 * Note: NOT thread-safe, call before writing.
+	 */
+	void enable_auto_tune(	size_t min_chunk_size = 64 * 1024,
+							size_t min_flush_bytes = 256 * 1024, size_t max_flush_bytes = 64 * 1024 * 1024)
+	{
+		chunk_tuner.reset(new AutoTuner(buffer_size, std::max<size_t>(min_chunk_size, page_size), buffer_size, 32 * buffer_size));
+		chunk_size = chunk_tuner->get_value();
+
+		if(auto_flush_bytes) {
+			flush_tuner.reset(new AutoTuner(auto_flush_bytes, min_flush_bytes, max_flush_bytes, 2 * max_flush_bytes));
+			flush_bytes = flush_tuner->get_value();
+			tune_last_bytes = stats.bytes_direct + stats.bytes_cached;
+			tune_last_time = get_time_ns();
+		}
+	}
+
+	/*
+	 * Enable sequential stream mode, for many threads writing consecutive ranges in random completion order:
+	 * completed ranges within `window_bytes` ahead of the contiguous written prefix are staged in a ring buffer,
+	 * and the prefix is written out with large aligned writes as soon as it advances (by a single thread at a time).
+	 * Writers wait when too far ahead. If the prefix does not advance for `stream_timeout_ms` (gap not written),
+	 * all staged data is written out and writes into the gap use the normal path.
+	 * flush() and read() write out staged data first.
+	 * Note: NOT thread-safe, call before writing.
+	 */
+	void enable_stream(size_t window_bytes = 64 * 1024 * 1024)
+	{
+		window_bytes = std::max<size_t>((window_bytes + align_mask) & ~size_t(align_mask), 4 * page_size);
+		stream_ring = aligned_buffer_t(window_bytes, page_size);
+		stream_window = window_bytes;
+	}
+
+	/*
+	 * Switch to buffered mode (clears O_DIRECT), as if Direct IO was not supported, see `write_behind_bytes`.
+	 * Mainly for testing the fallback on file systems that support O_DIRECT.
+	 * Note: NOT thread-safe, call before any I/O.
+	 */
+	void disable_direct_io()
+	{
+		if(!direct_flag) {
+			return;
+		}
+		const int flags = ::fcntl(fd, F_GETFL);
+		if(flags < 0 || ::fcntl(fd, F_SETFL, flags & ~O_DIRECT) < 0) {
+			throw std::runtime_error("fcntl() failed with: " + std::string(std::strerror(errno)));
+		}
+		direct_flag = false;
+	}
+
+	/*
+	 * Enable caching of clean pages for reads of up to `max_run_bytes` (larger reads bypass the cache).
+	 * Uses scan-resistant replacement, see ReadCache. Pages are invalidated by write().
+	 * Also enables read-ahead for small read() calls, see `max_read_ahead`.
+	 * Note: NOT thread-safe, call before reading.
+	 */
+	void enable_read_cache(size_t max_bytes, size_t max_run_bytes = 64 * 1024)
+	{
+		read_cache.reset(new ReadCache(max_bytes >> log_page_size));
+		read_cache_max_run = max_run_bytes;
+	}
+
+	/*
+	 * Limit device writes of this file to `bytes_per_sec` and `ops_per_sec` (0 = unlimited),
+	 * allowing bursts of `burst_sec` worth of I/O, see RateLimiter.
+	 * Applies to aligned writes and page flushes, each pwrite() counts as one operation.
+	 * Note: NOT thread-safe, call before writing.
+	 */
+	void set_rate_limit(uint64_t bytes_per_sec, uint64_t ops_per_sec = 0, double burst_sec = 0.1)
+	{
+		rate_limiter.reset(new RateLimiter(bytes_per_sec, ops_per_sec, burst_sec));
+	}
+
+	/*
+	 * Same as set_rate_limit(), but shared by all files on the same device (st_dev) that enabled it,
+	 * the last call configures the limit. Both limits apply when set.
+	 * Note: NOT thread-safe, call before writing.
+	 */
+	void set_device_rate_limit(uint64_t bytes_per_sec, uint64_t ops_per_sec = 0, double burst_sec = 0.1)
+	{
+		struct stat info = {};
+		if(::fstat(fd, &info) < 0) {
+			throw std::runtime_error("fstat() failed with: " + std::string(std::strerror(errno)));
+		}
+		device_limiter = RateLimiter::get_device(info.st_dev);
+		device_limiter->set_limit(bytes_per_sec, ops_per_sec, burst_sec);
 	}
 
 	/*
@@ -97,165 +405,1970 @@ public:
 	 */
 	void write(const void* data, const size_t length, const uint64_t offset, buffer_t& buffer)
 	{
+		if(!write_flag) {
+			throw std::logic_error("write() on read-only file");
+		}
 		if(!buffer.data) {
 			buffer.data = (uint8_t*)::aligned_alloc(page_size, buffer_size);
 		}
+		MAD_PROBE2(write_entry, offset, length);
 
-		size_t total = 0;
-		size_t cache_size = 0;
+		if(profiler) {
+			profiler->add(offset, length, log_page_size);
+		}
+
+		const auto trace_begin = trace ? trace->now() : 0;
+
+		check_auto_flush(write_unchecked((const uint8_t*)data, length, offset, buffer));
+
+		if(trace) {
+			trace->record(IOTrace::OP_WRITE, offset, length, trace_begin);
+		}
+		MAD_PROBE2(write_exit, offset, length);
+	}
 
+	/*
+	 * Same as write(), but without blocking: aligned writes use pwritev2(RWF_NOWAIT), if that would block
+	 * (or is not supported), the lock is contended or a partial page needs to be read first,
+	 * the remaining data is copied and written by the I/O thread pool.
+	 * Returns true if done, false if deferred, in which case a completion for the whole write is queued,
+	 * see reap_completions(). Any auto flush is deferred as well.
+	 * `data` can be re-used right away in both cases.
+	 * Note: thread-safe
+	 */
+	bool try_write(const void* data, const size_t length, const uint64_t offset, buffer_t& buffer, const uint64_t user_data = 0)
+	{
+		if(!write_flag) {
+			throw std::logic_error("try_write() on read-only file");
+		}
+		if(!buffer.data) {
+			buffer.data = (uint8_t*)::aligned_alloc(page_size, buffer_size);
+		}
+		if(profiler) {
+			profiler->add(offset, length, log_page_size);
+		}
+		const auto trace_begin = trace ? trace->now() : 0;
 		const auto src = (const uint8_t*)data;
-		{
-			const auto offset_mod = offset & align_mask;
-			if(offset_mod) {
-				// handle unaligned start address
-				const auto count = std::min<size_t>(page_size - offset_mod, length);
-				{
-					std::lock_guard<std::mutex> lock(mutex);
-					::memcpy(get_page(offset) + offset_mod, data, count);
 
-					if(sequential_write) {
-						if(offset_mod + count == page_size) {
-							flush_no_lock();
-						}
-					}
-					cache_size = cache.size();
-				}
+		size_t total = 0;
+		size_t cache_size = 0;
+		// stream mode may need to wait for space
+		bool would_block = stream_window > 0 || nowait_failed.load(std::memory_order_relaxed);
+
+		if(!would_block && (offset & align_mask)) {
+			const auto count = std::min<size_t>(page_size - (offset & align_mask), length);
+			cache_size = write_cached(src, count, offset, &would_block);
+			if(!would_block) {
 				total += count;
 			}
 		}
+		const size_t max_chunk = chunk_tuner ? chunk_size.load(std::memory_order_relaxed) : buffer_size;
 
-		while(total < length)
+		while(!would_block && total < length)
 		{
-			size_t count = std::min<size_t>(length - total, buffer_size);
+			size_t count = std::min<size_t>(length - total, max_chunk);
 			if(count >= page_size) {
-				count &= ~size_t(align_mask);	// align count to page size
+				count &= ~size_t(align_mask);
 
 				::memcpy(buffer.data, src + total, count);
 
-				const auto addr = offset + total;
-				if(::pwrite(fd, buffer.data, count, addr) != ssize_t(count)) {
-					throw std::runtime_error("pwrite() failed with: " + std::string(std::strerror(errno)));
-				}
-				const auto begin = addr >> log_page_size;
-				const auto end = (addr + count) >> log_page_size;
-
-				std::lock_guard<std::mutex> lock(mutex);
-
-				// discard any cached pages that we just over-wrote
-				for(auto iter = cache.lower_bound(begin); iter != cache.end();)
-				{
-					if(iter->first < end) {
-						::free(iter->second);
-						iter = cache.erase(iter);
-					} else {
-						break;
-					}
-				}
-				cache_size = cache.size();
+				cache_size = write_aligned(buffer.data, count, offset + total, &would_block);
 			} else {
-				// final unaligned tail
-				std::lock_guard<std::mutex> lock(mutex);
-				::memcpy(get_page(offset + total), src + total, count);
-				cache_size = cache.size();
+				cache_size = write_cached(src + total, count, offset + total, &would_block);
+			}
+			if(would_block) {
+				break;
 			}
 			total += count;
 		}
+		const auto flush_limit = flush_tuner ? flush_bytes.load() : auto_flush_bytes;
+		const bool need_flush = flush_limit && cache_size * page_size >= flush_limit;
 
-		if(auto_flush_bytes) {
-			if(cache_size * page_size >= auto_flush_bytes) {
-				flush();
-			}
+		if(would_block || need_flush) {
+			defer_write(src + total, length - total, offset + total, cache_size, offset, length, user_data);
 		}
+		if(trace) {
+			trace->record(IOTrace::OP_WRITE, offset, length, trace_begin);
+		}
+		return !would_block && !need_flush;
 	}
 
 	/*
-	 * Flush all cached pages to file.
+	 * Read `length` bytes at `offset`, including data not yet flushed.
+	 * Bytes beyond the end of file read as zero.
+	 * Avoids copying when `data` and `offset` have the same page alignment, see alloc_buffer().
 	 * Note: thread-safe
+	 * Note: `buffer` should be default initialized and re-used between calls from the same thread.
 	 */
-	void flush()
+	void read(void* data, const size_t length, const uint64_t offset, buffer_t& buffer)
 	{
-		if(fd < 0) {
-			return;
+		if(!buffer.data) {
+			buffer.data = (uint8_t*)::aligned_alloc(page_size, buffer_size);
 		}
-		std::lock_guard<std::mutex> lock(mutex);
+		const bool stream = check_read_ahead(buffer.stream, offset, length);
 
-		flush_no_lock();
+		read_impl(data, length, offset, buffer.data, stream);
 	}
 
 	/*
-	 * Flush cache and close file.
-	 * Note: NOT thread-safe
+	 * Read `length` bytes at `offset` without copying into caller memory, same data as read().
+	 * If the range is within a page of the read cache, the view points to the cached page directly,
+	 * otherwise data is read into a pooled aligned buffer.
+	 * Later writes do not change the data of an existing view.
+	 * Note: all views need to be dropped before the file is destroyed.
+	 * Note: thread-safe
 	 */
-	void close()
+	view_t read_view(const uint64_t offset, const size_t length)
 	{
-		if(fd >= 0) {
-			flush();
-			if(::close(fd) < 0) {
-				throw std::runtime_error("close() failed with: " + std::string(std::strerror(errno)));
+		view_t view;
+		if(!length) {
+			return view;
+		}
+		const auto begin = offset & ~uint64_t(align_mask);
+		const auto end = align_up(offset + length);
+
+		if(read_cache && end - begin == page_size) {
+			const auto index = offset >> log_page_size;
+			drain_staged();
+			const auto lock = acquire_lock();
+			if(!cache.count(index)) {
+				if(const auto page = read_cache->find(index)) {
+					pinned_pages[page]++;
+					view.data = page + (offset - begin);
+					view.length = length;
+					view.handle = std::shared_ptr<void>((void*)page,
+						[this](void* page) {
+							unpin_page((uint8_t*)page);
+						});
+					return view;
+				}
 			}
-			fd = -1;
 		}
+		const auto size = end - begin;
+		const auto buffer = alloc_view_buffer(size);
+		try {
+			read_aligned(buffer, begin, size);
+		} catch(...) {
+			free_view_buffer(buffer, size);
+			throw;
+		}
+		view.data = buffer + (offset - begin);
+		view.length = length;
+		view.handle = std::shared_ptr<void>((void*)buffer,
+			[this, size](void* buffer) {
+				free_view_buffer((uint8_t*)buffer, size);
+			});
+		return view;
 	}
 
-	// returns true when actually using Direct IO
-	bool is_direct() const {
-		return direct_flag;
+	/*
+	 * Same as read(), but asynchronously using the I/O thread pool.
+	 * `data` needs to stay valid until the returned future is ready.
+	 * Note: thread-safe
+	 */
+	std::future<void> read_async(void* data, const size_t length, const uint64_t offset)
+	{
+		const auto promise = std::make_shared<std::promise<void>>();
+		get_pool().add_task([this, promise, data, length, offset]() {
+			try {
+				read_impl(data, length, offset, get_thread_buffer(buffer_size), false);
+				promise->set_value();
+			} catch(...) {
+				promise->set_exception(std::current_exception());
+			}
+		});
+		return promise->get_future();
 	}
 
-protected:
-	uint8_t* get_page(const uint64_t address)
+	/*
+	 * Asynchronous write(), executed by the I/O thread pool.
+	 * `data` needs to stay valid until the completion is reaped, see reap_completions().
+	 * Note: thread-safe
+	 */
+	void submit_write(const void* data, const size_t length, const uint64_t offset, const uint64_t user_data = 0)
 	{
-		const auto index = address >> log_page_size;
-		auto& page = cache[index];
-		if(!page) {
-			page = (uint8_t*)::aligned_alloc(page_size, page_size);
-			if(read_flag) {
-				const auto ret = ::pread(fd, page, page_size, index * page_size);
-				if(ret <= 0) {
-					::memset(page, 0, page_size);
-				} else {
-					::memset(page + ret, 0, page_size - ret);
-				}
-			} else {
-				::memset(page, 0, page_size);
-			}
+		if(!write_flag) {
+			throw std::logic_error("submit_write() on read-only file");
 		}
-		return page;
+		submit(ASYNC_WRITE, offset, length, user_data,
+			[this, data, length, offset](buffer_t& buffer) {
+				write(data, length, offset, buffer);
+			});
 	}
 
-	void flush_page(const uint64_t index, uint8_t*& page)
+	/*
+	 * Asynchronous read(), executed by the I/O thread pool.
+	 * `data` needs to stay valid until the completion is reaped, see reap_completions().
+	 * Note: thread-safe
+	 */
+	void submit_read(void* data, const size_t length, const uint64_t offset, const uint64_t user_data = 0)
 	{
-		if(::pwrite(fd, page, page_size, index * page_size) != ssize_t(page_size)) {
-			throw std::runtime_error("pwrite() on flush failed with: " + std::string(std::strerror(errno)));
+		submit(ASYNC_READ, offset, length, user_data,
+			[this, data, length, offset](buffer_t& buffer) {
+				read(data, length, offset, buffer);
+			});
+	}
+
+	/*
+	 * Asynchronous flush(), executed by the I/O thread pool.
+	 * Only covers writes that completed before it started.
+	 * Note: thread-safe
+	 */
+	void submit_flush(const uint64_t user_data = 0)
+	{
+		submit(ASYNC_FLUSH, 0, 0, user_data,
+			[this](buffer_t&) {
+				flush();
+			});
+	}
+
+	/*
+	 * Returns an eventfd (non-blocking) that becomes readable when completions are ready,
+	 * to be polled by an external event loop (epoll, etc), then call reap_completions().
+	 * The fd is owned by this object and stays valid until destruction.
+	 * Note: thread-safe
+	 */
+	int get_completion_fd()
+	{
+		std::lock_guard<std::mutex> lock(completion_mutex);
+		if(completion_fd < 0) {
+			completion_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+			if(completion_fd < 0) {
+				throw std::runtime_error("eventfd() failed with: " + std::string(std::strerror(errno)));
+			}
+			if(!completions.empty()) {
+				signal_completion();
+			}
 		}
-		::free(page);
-		page = nullptr;
+		return completion_fd;
 	}
 
-	void flush_no_lock()
+	/*
+	 * Returns up to `max_count` finished operations in order of completion, without blocking.
+	 * Also resets the completion fd, which is signaled again if more completions remain.
+	 * Note: thread-safe
+	 */
+	std::vector<completion_t> reap_completions(const size_t max_count = size_t(-1))
 	{
-		for(auto& entry : cache) {
-			flush_page(entry.first, entry.second);
+		std::vector<completion_t> out;
+		std::lock_guard<std::mutex> lock(completion_mutex);
+		if(completion_fd >= 0) {
+			uint64_t count = 0;
+			if(::read(completion_fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+				throw std::runtime_error("read() failed with: " + std::string(std::strerror(errno)));
+			}
 		}
-		cache.clear();
+		while(!completions.empty() && out.size() < max_count) {
+			out.push_back(std::move(completions.front()));
+			completions.pop_front();
+		}
+		if(!completions.empty()) {
+			signal_completion();
+		}
+		return out;
+	}
 
-		read_flag = true;
+	// returns number of submitted operations not finished yet (not including completions to reap)
+	size_t get_num_in_flight() {
+		std::lock_guard<std::mutex> lock(completion_mutex);
+		return num_in_flight;
 	}
 
-private:
-	bool read_flag;
-	const bool write_flag;
-	const int log_page_size;
-	const uint32_t page_size;
-	const uint32_t align_mask;
-	const size_t buffer_size;
+	/*
+	 * Asynchronously load the pages covering [offset, offset + length) into the read cache,
+	 * such that following read() calls are served from memory. Pages are inserted as hot,
+	 * but the cache needs to be large enough to hold them.
+	 * Note: requires enable_read_cache()
+	 * Note: thread-safe
+	 */
+	std::future<void> prefetch(const uint64_t offset, const uint64_t length)
+	{
+		if(!read_cache) {
+			throw std::logic_error("prefetch() requires enable_read_cache()");
+		}
+		const auto begin = offset >> log_page_size;
+		const auto end = align_up(offset + length) >> log_page_size;
+		const uint64_t max_chunk = std::max<uint64_t>(buffer_size >> log_page_size, 1);
 
-	int fd = -1;
-	bool direct_flag = false;
+		std::vector<std::pair<uint64_t, uint64_t>> chunks;
+		for(auto index = begin; index < end; index += max_chunk) {
+			chunks.emplace_back(index, std::min(index + max_chunk, end));
+		}
+		auto& pool = get_pool();
+		const auto promise = std::make_shared<std::promise<void>>();
+		pool.add_task([this, &pool, promise, chunks]() {
+			try {
+				pool.run_parallel(chunks.size(),
+					[this, &chunks](const size_t i) {
+						load_pages(chunks[i].first, chunks[i].second, true);
+					}, num_io_threads);
+				promise->set_value();
+			} catch(...) {
+				promise->set_exception(std::current_exception());
+			}
+		});
+		return promise->get_future();
+	}
 
-	std::mutex mutex;
-	std::map<uint64_t, uint8_t*> cache;
+	/*
+	 * Give a hint about future reads in [offset, offset + length), see advice_e.
+	 * ADVISE_SEQUENTIAL and ADVISE_RANDOM are remembered for the range (until ADVISE_NORMAL),
+	 * ADVISE_WILLNEED starts a prefetch() and ADVISE_DONTNEED drops the range from the read cache.
+	 * Note: thread-safe
+	 */
+	void advise(const uint64_t offset, const uint64_t length, const advice_e advice)
+	{
+		switch(advice) {
+			case ADVISE_WILLNEED:
+				if(read_cache) {
+					prefetch(offset, length);
+				}
+				break;
+			case ADVISE_DONTNEED:
+				if(read_cache) {
+					const auto lock = acquire_lock();
+					invalidate_read_cache(offset >> log_page_size, align_up(offset + length) >> log_page_size);
+				}
+				break;
+			default: {
+				std::lock_guard<std::mutex> lock(advice_mutex);
+				set_advice(offset, offset + length, advice);
+				has_advice = !advice_map.empty();
+			}
+		}
+	}
+
+	/*
+	 * Read many small pieces at once. Requests are sorted and merged, such that requests
+	 * in the same or adjacent pages are served by a single device read (up to `buffer_size`).
+	 * Requests may overlap, results are the same as individual read() calls.
+	 * @param num_threads Number of device reads in flight (using the I/O thread pool)
+	 * Note: thread-safe
+	 */
+	void read_batch(const std::vector<read_request_t>& requests, const int num_threads = 1)
+	{
+		struct run_t {
+			uint64_t begin = 0;		// first page
+			uint64_t end = 0;		// last page + 1
+			size_t first = 0;		// range in `sorted`
+			size_t last = 0;
+		};
+		std::vector<const read_request_t*> sorted;
+		sorted.reserve(requests.size());
+		for(const auto& req : requests) {
+			if(req.length) {
+				sorted.push_back(&req);
+			}
+		}
+		std::sort(sorted.begin(), sorted.end(),
+			[](const read_request_t* L, const read_request_t* R) -> bool {
+				return L->offset < R->offset;
+			});
+
+		const uint64_t max_pages = std::max<uint64_t>(buffer_size >> log_page_size, 1);
+
+		std::vector<run_t> runs;
+		for(size_t i = 0; i < sorted.size(); ++i)
+		{
+			const auto& req = *sorted[i];
+			const auto begin = req.offset >> log_page_size;
+			const auto end = ((req.offset + req.length - 1) >> log_page_size) + 1;
+
+			if(!runs.empty()) {
+				auto& run = runs.back();
+				if(begin <= run.end && std::max(end, run.end) - run.begin <= max_pages) {
+					run.end = std::max(end, run.end);
+					run.last = i + 1;
+					continue;
+				}
+			}
+			run_t run;
+			run.begin = begin;
+			run.end = end;
+			run.first = i;
+			run.last = i + 1;
+			runs.push_back(run);
+		}
+
+		uint64_t max_run = 0;
+		for(const auto& run : runs) {
+			max_run = std::max(max_run, run.end - run.begin);
+		}
+		const auto func = [this, &runs, &sorted, max_run](const size_t k)
+		{
+			const auto& run = runs[k];
+			const auto length = (run.end - run.begin) << log_page_size;
+			const auto tmp = get_thread_buffer(std::max(max_run << log_page_size, length));
+
+			const auto base = run.begin << log_page_size;
+			read_aligned(tmp, base, length);
+
+			for(size_t i = run.first; i < run.last; ++i) {
+				const auto& req = *sorted[i];
+				::memcpy(req.data, tmp + (req.offset - base), req.length);
+			}
+		};
+		if(num_threads > 1 && runs.size() > 1) {
+			get_pool().run_parallel(runs.size(), func, num_threads);
+		} else {
+			for(size_t k = 0; k < runs.size(); ++k) {
+				func(k);
+			}
+		}
+	}
+
+	/*
+	 * Flush all cached pages to file.
+	 * Note: thread-safe
+	 */
+	void flush()
+	{
+		if(fd < 0) {
+			return;
+		}
+		const auto trace_begin = trace ? trace->now() : 0;
+		if(stream_window) {
+			std::unique_lock<std::mutex> lock(stream_mutex);
+			drain_stream(lock);
+		}
+		{
+			std::lock_guard<std::mutex> flush_lock(flush_mutex);
+			const auto reserved = reserve_flush();
+			const auto lock = acquire_lock();
+
+			flush_no_lock(reserved);
+		}
+		write_behind();
+
+		if(trace) {
+			trace->record(IOTrace::OP_FLUSH, 0, 0, trace_begin);
+		}
+	}
+
+	/*
+	 * Flush cache and close file.
+	 * Note: NOT thread-safe
+	 */
+	void close()
+	{
+		if(fd >= 0) {
+			pool.reset();
+			flush();
+			if(!direct_flag) {
+				finish_write_behind();
+			}
+			if(::close(fd) < 0) {
+				throw std::runtime_error("close() failed with: " + std::string(std::strerror(errno)));
+			}
+			fd = -1;
+
+			if(profiler) {
+				profiler->print_summary();
+			}
+		}
+	}
+
+	// returns true when actually using Direct IO
+	bool is_direct() const {
+		return direct_flag;
+	}
+
+	bool is_read_only() const {
+		return !write_flag;
+	}
+
+	size_t get_page_size() const {
+		return page_size;
+	}
+
+	/*
+	 * Returns current size of file on device (not including data that is not yet flushed).
+	 * Note: thread-safe
+	 */
+	uint64_t get_file_size() const
+	{
+		struct stat info = {};
+		if(::fstat(fd, &info) < 0) {
+			throw std::runtime_error("fstat() failed with: " + std::string(std::strerror(errno)));
+		}
+		return info.st_size;
+	}
+
+	// returns a buffer suitable for zero-copy read()
+	aligned_buffer_t alloc_buffer(const size_t size) const {
+		return aligned_buffer_t(size, page_size);
+	}
+
+	/*
+	 * Returns a snapshot of the performance counters.
+	 * Note: thread-safe
+	 */
+	stats_t get_stats()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto out = stats;
+		out.num_read += num_read_direct;
+		out.bytes_read += bytes_read_direct;
+		out.bytes_hole = bytes_hole;
+		out.num_write_deferred = num_write_deferred;
+		out.num_throttled = num_throttled;
+		out.throttle_ns = throttle_ns;
+		out.io_mode = direct_flag ? IO_MODE_DIRECT : IO_MODE_BUFFERED;
+		{
+			std::lock_guard<std::mutex> lock(write_behind_mutex);
+			out.num_write_behind = num_write_behind;
+		}
+		{
+			std::lock_guard<std::mutex> lock(stream_mutex);
+			out.num_stream_emit = num_stream_emit;
+			out.num_stream_wait = num_stream_wait;
+		}
+		out.chunk_size = chunk_tuner ? chunk_size.load() : buffer_size;
+		out.auto_flush_bytes = flush_tuner ? flush_bytes.load() : auto_flush_bytes;
+		if(read_cache) {
+			out.read_cache_hit = read_cache->num_hit;
+			out.read_cache_miss = read_cache->num_miss;
+		}
+		return out;
+	}
+
+protected:
+	/*
+	 * Device I/O, can be overridden to mock the device (for example in benchmarks).
+	 */
+	virtual ssize_t do_pwrite(const void* data, const size_t count, const uint64_t offset) {
+		return ::pwrite(fd, data, count, offset);
+	}
+
+	/*
+	 * Same as do_pwrite(), but fails with EAGAIN instead of blocking (or EOPNOTSUPP if not supported).
+	 */
+	virtual ssize_t do_pwrite_nowait(const void* data, const size_t count, const uint64_t offset) {
+#ifdef RWF_NOWAIT
+		struct iovec vec = {const_cast<void*>(data), count};
+		return ::pwritev2(fd, &vec, 1, offset, RWF_NOWAIT);
+#else
+		errno = EOPNOTSUPP;
+		return -1;
+#endif
+	}
+
+	virtual ssize_t do_pread(void* data, const size_t count, const uint64_t offset) {
+		return ::pread(fd, data, count, offset);
+	}
+
+	IOTrace* get_detail_trace() const {
+		return trace && trace->detail ? trace : nullptr;
+	}
+
+	uint64_t align_up(const uint64_t address) const {
+		return (address + align_mask) & ~uint64_t(align_mask);
+	}
+
+	ThreadPool& get_pool()
+	{
+		std::lock_guard<std::mutex> lock(pool_mutex);
+		if(!pool) {
+			pool.reset(new ThreadPool(num_io_threads));
+		}
+		return *pool;
+	}
+
+	/*
+	 * Run `func` with a pooled buffer in the I/O thread pool, then queue its completion.
+	 */
+	template<typename F>
+	void submit(const async_op_e op, const uint64_t offset, const size_t length, const uint64_t user_data, const F& func)
+	{
+		{
+			std::lock_guard<std::mutex> lock(completion_mutex);
+			num_in_flight++;
+		}
+		get_pool().add_task([this, op, offset, length, user_data, func]() {
+			completion_t out;
+			out.user_data = user_data;
+			out.op = op;
+			out.offset = offset;
+			out.length = length;
+
+			std::unique_ptr<buffer_t> buffer;
+			{
+				std::lock_guard<std::mutex> lock(completion_mutex);
+				if(!async_buffers.empty()) {
+					buffer = std::move(async_buffers.back());
+					async_buffers.pop_back();
+				}
+			}
+			if(!buffer) {
+				buffer.reset(new buffer_t());
+				buffer->data = (uint8_t*)::aligned_alloc(page_size, buffer_size);
+			}
+			try {
+				func(*buffer);
+			} catch(...) {
+				out.error = std::current_exception();
+			}
+			std::lock_guard<std::mutex> lock(completion_mutex);
+			async_buffers.push_back(std::move(buffer));
+			completions.push_back(std::move(out));
+			num_in_flight--;
+			signal_completion();
+		});
+	}
+
+	/*
+	 * Finish a try_write() in the I/O thread pool: write remaining data [offset, offset + length),
+	 * followed by an auto flush if needed (`cache_size` is the number of cached pages so far).
+	 * The completion covers the whole write [write_offset, write_offset + write_length).
+	 * Note: profiler and trace are recorded by try_write() already
+	 */
+	void defer_write(	const uint8_t* src, const size_t length, const uint64_t offset, const size_t cache_size,
+						const uint64_t write_offset, const size_t write_length, const uint64_t user_data)
+	{
+		const auto copy = std::make_shared<std::vector<uint8_t>>(src, src + length);
+		num_write_deferred++;
+		submit(ASYNC_WRITE, write_offset, write_length, user_data,
+			[this, copy, offset, cache_size](buffer_t& buffer) {
+				if(copy->size()) {
+					check_auto_flush(write_unchecked(copy->data(), copy->size(), offset, buffer));
+				} else {
+					check_auto_flush(cache_size);
+				}
+			});
+	}
+
+	// Note: completion_mutex needs to be locked
+	void signal_completion()
+	{
+		if(completion_fd >= 0) {
+			const uint64_t one = 1;
+			if(::write(completion_fd, &one, sizeof(one)) < 0) {
+				// can only fail with EAGAIN on counter overflow, in which case it's still readable
+			}
+		}
+	}
+
+	/*
+	 * Implementation of write() without auto flush, profiler and trace, returns number of cached pages.
+	 */
+	size_t write_unchecked(const uint8_t* src, const size_t length, const uint64_t offset, buffer_t& buffer)
+	{
+		if(stream_window) {
+			return stream_write(src, length, offset, buffer);
+		}
+		return write_range(src, length, offset, buffer);
+	}
+
+	// flush if `cache_size` pages exceed the auto flush threshold
+	void check_auto_flush(const size_t cache_size)
+	{
+		if(flush_tuner) {
+			if(cache_size * page_size >= flush_bytes) {
+				auto_flush();
+				write_behind();
+			}
+		} else if(auto_flush_bytes) {
+			if(cache_size * page_size >= auto_flush_bytes) {
+				{
+					std::lock_guard<std::mutex> flush_lock(flush_mutex);
+					const auto reserved = reserve_flush(auto_flush_bytes);
+					const auto lock = acquire_lock();
+
+					if(cache.size() * page_size >= auto_flush_bytes) {
+						flush_no_lock(reserved);
+					} else {
+						unthrottle(reserved * page_size, reserved);		// another thread was faster
+					}
+				}
+				write_behind();
+			}
+		}
+	}
+
+	/*
+	 * Implementation of write() without stream, returns number of cached pages.
+	 */
+	size_t write_range(const uint8_t* src, const size_t length, const uint64_t offset, buffer_t& buffer)
+	{
+		size_t total = 0;
+		size_t cache_size = 0;
+
+		if(offset & align_mask) {
+			// handle unaligned start address
+			const auto count = std::min<size_t>(page_size - (offset & align_mask), length);
+			cache_size = write_cached(src, count, offset);
+			total += count;
+		}
+		const size_t max_chunk = chunk_tuner ? chunk_size.load(std::memory_order_relaxed) : buffer_size;
+
+		while(total < length)
+		{
+			size_t count = std::min<size_t>(length - total, max_chunk);
+			if(count >= page_size) {
+				count &= ~size_t(align_mask);	// align count to page size
+
+				::memcpy(buffer.data, src + total, count);
+
+				cache_size = write_aligned(buffer.data, count, offset + total);
+			} else {
+				// final unaligned tail
+				cache_size = write_cached(src + total, count, offset + total);
+			}
+			total += count;
+		}
+		return cache_size;
+	}
+
+	/*
+	 * Copy data within a single page into cache, returns number of cached pages.
+	 * @param would_block If not null, don't block and set to true if the write needs to be retried (see try_write())
+	 */
+	size_t write_cached(const uint8_t* src, const size_t count, const uint64_t offset, bool* would_block = nullptr)
+	{
+		const auto detail = get_detail_trace();
+		const auto detail_begin = detail ? detail->now() : 0;
+		const auto offset_mod = offset & align_mask;
+		const auto index = offset >> log_page_size;
+
+		size_t cache_size = 0;
+		{
+			const auto lock = acquire_lock(would_block);
+			if(!lock) {
+				return 0;
+			}
+			if(would_block && read_flag && !cache.count(index) && !(read_cache && read_cache->contains(index))) {
+				*would_block = true;		// would need to read page from device
+				return 0;
+			}
+			::memcpy(get_page(offset) + offset_mod, src, count);
+			stats.bytes_cached += count;
+
+			if(sequential_write && !would_block) {
+				if(offset_mod && offset_mod + count == page_size) {
+					flush_no_lock();
+				}
+			}
+			cache_size = cache.size();
+		}
+		if(sequential_write && !would_block) {
+			write_behind();
+		}
+		if(detail) {
+			detail->record(IOTrace::OP_CACHE_WRITE, offset, count, detail_begin);
+		}
+		return cache_size;
+	}
+
+	/*
+	 * Write whole pages directly, `src`, `count` and `addr` need to be page aligned.
+	 * Returns number of cached pages.
+	 * @param would_block If not null, don't block and set to true if the write needs to be retried (see try_write())
+	 */
+	size_t write_aligned(const uint8_t* src, const size_t count, const uint64_t addr, bool* would_block = nullptr)
+	{
+		const auto detail = get_detail_trace();
+		const auto begin = addr >> log_page_size;
+		const auto end = (addr + count) >> log_page_size;
+
+		if(!throttle(count, 1, would_block)) {
+			return 0;
+		}
+		size_t cache_size = 0;
+		{
+			const auto lock = acquire_lock(would_block);
+			if(!lock) {
+				unthrottle(count);
+				return 0;
+			}
+			// discard any cached pages that we are going to over-write
+			// Note: needs to happen before pwrite(), otherwise a concurrent flush could write stale pages over it
+			for(auto iter = cache.lower_bound(begin); iter != cache.end();)
+			{
+				if(iter->first < end) {
+					free_page(iter->second);
+					iter = cache.erase(iter);
+				} else {
+					break;
+				}
+			}
+			invalidate_read_cache(begin, end);
+			cache_size = cache.size();
+		}
+		const auto time_begin = chunk_tuner ? get_time_ns() : 0;
+		const auto detail_begin = detail ? detail->now() : 0;
+
+		MAD_PROBE2(pwrite_entry, addr, count);
+		if(would_block) {
+			size_t total = 0;
+			while(total < count) {
+				const auto ret = do_pwrite_nowait(src + total, count - total, addr + total);
+				if(ret <= 0) {
+					if(ret < 0 && errno == EOPNOTSUPP) {
+						nowait_failed = true;
+						break;
+					}
+					if(ret < 0 && errno == EAGAIN) {
+						break;
+					}
+					throw std::runtime_error("pwritev2() failed with: " + std::string(std::strerror(errno)));
+				}
+				total += ret;
+			}
+			if(total < count) {
+				// pages were discarded from cache, so a retry needs to cover the whole range
+				// Note: bytes already written were paid for, as well as the operation if any
+				unthrottle(count - total, total ? 0 : 1);
+				*would_block = true;
+				return cache_size;
+			}
+		}
+		else if(do_pwrite(src, count, addr) != ssize_t(count)) {
+			throw std::runtime_error("pwrite() failed with: " + std::string(std::strerror(errno)));
+		}
+		MAD_PROBE2(pwrite_exit, addr, count);
+
+		add_dirty(addr, count);
+		write_behind();
+
+		if(detail) {
+			detail->record(IOTrace::OP_PWRITE, addr, count, detail_begin);
+		}
+		{
+			const auto time_end = chunk_tuner ? get_time_ns() : 0;
+			const auto lock = acquire_lock();
+			stats.num_pwrite++;
+			stats.bytes_direct += count;
+
+			if(chunk_tuner && chunk_tuner->add_sample(count, time_end - time_begin)) {
+				chunk_size = chunk_tuner->get_value();
+			}
+			// again, in case a concurrent read() cached old data in the meantime
+			invalidate_read_cache(begin, end);
+		}
+		return cache_size;
+	}
+
+	/*
+	 * Implementation of write() in stream mode, see enable_stream().
+	 * Data ahead of the contiguous prefix is staged in the ring, data before it is written normally.
+	 * Returns number of cached pages.
+	 */
+	size_t stream_write(const uint8_t* src, const size_t length, const uint64_t offset, buffer_t& buffer)
+	{
+		size_t cache_size = 0;
+		const auto end = offset + length;
+		const uint64_t max_piece = stream_window - page_size;
+
+		std::unique_lock<std::mutex> lock(stream_mutex);
+
+		uint64_t pos = offset;
+		while(pos < end)
+		{
+			if(pos < stream_begin) {
+				// already written out, or skipped by drain
+				const auto count = std::min(end, stream_begin) - pos;
+				lock.unlock();
+				cache_size = write_range(src + (pos - offset), count, pos, buffer);
+				lock.lock();
+				pos += count;
+				continue;
+			}
+			const auto count = std::min(end - pos, max_piece);
+
+			// wait for space in the window
+			auto wait_begin = std::chrono::steady_clock::now();
+			// also wait while the range is being written out, otherwise it could be torn
+			while(pos >= stream_begin && (stream_draining || (stream_emitting && pos < stream_emit_end)
+					|| pos + count > (stream_begin & ~uint64_t(align_mask)) + stream_window))
+			{
+				if(stream_staged.empty() && !stream_copying && !stream_emitting && !stream_draining) {
+					stream_begin = pos;		// (re-)start stream here
+					break;
+				}
+				if(try_emit(lock)) {
+					wait_begin = std::chrono::steady_clock::now();
+					continue;
+				}
+				if(std::chrono::steady_clock::now() - wait_begin > std::chrono::milliseconds(stream_timeout_ms)) {
+					// no progress, gap is not being filled, write out everything
+					drain_stream(lock);
+					wait_begin = std::chrono::steady_clock::now();
+					continue;
+				}
+				num_stream_wait++;
+				stream_waiting++;
+				stream_signal.wait_for(lock, std::chrono::milliseconds(1));
+				stream_waiting--;
+			}
+			if(pos < stream_begin) {
+				continue;
+			}
+			stream_copying++;
+			lock.unlock();
+
+			copy_to_stream(src + (pos - offset), count, pos);
+
+			lock.lock();
+			stream_copying--;
+
+			// add to staged ranges, merging with all overlapping or adjacent ranges
+			auto range_begin = pos;
+			auto range_end = pos + count;
+			auto iter = stream_staged.upper_bound(range_begin);
+			if(iter != stream_staged.begin()) {
+				const auto prev = std::prev(iter);
+				if(prev->second >= range_begin) {
+					iter = prev;
+				}
+			}
+			while(iter != stream_staged.end() && iter->first <= range_end) {
+				range_begin = std::min(range_begin, iter->first);
+				range_end = std::max(range_end, iter->second);
+				iter = stream_staged.erase(iter);
+			}
+			stream_staged[range_begin] = range_end;
+			stream_end = std::max(stream_end, pos + count);
+
+			try_emit(lock);
+			stream_signal.notify_all();
+			pos += count;
+		}
+		return cache_size;
+	}
+
+	void copy_to_stream(const uint8_t* src, const uint64_t count, const uint64_t offset)
+	{
+		uint64_t total = 0;
+		while(total < count) {
+			const auto ring_pos = (offset + total) % stream_window;
+			const auto num = std::min(count - total, stream_window - ring_pos);
+			::memcpy(stream_ring.data() + ring_pos, src + total, num);
+			total += num;
+		}
+	}
+
+	/*
+	 * Write out contiguous prefix (whole pages only), if large enough or somebody is waiting for space.
+	 * Returns true if something was written. Requires `stream_mutex` (via `lock`).
+	 */
+	bool try_emit(std::unique_lock<std::mutex>& lock)
+	{
+		if(stream_emitting || stream_draining || stream_staged.empty()) {
+			return false;
+		}
+		const auto first = stream_staged.begin();
+		if(first->first != stream_begin) {
+			return false;		// gap
+		}
+		const auto emit_end = first->second & ~uint64_t(align_mask);
+		if(emit_end <= stream_begin || (emit_end - stream_begin < stream_window / 4 && !stream_waiting)) {
+			return false;
+		}
+		stream_emitting = true;
+		stream_emit_end = emit_end;
+		lock.unlock();
+		try {
+			write_stream_range(stream_begin, emit_end);
+		} catch(...) {
+			lock.lock();
+			stream_emitting = false;
+			stream_signal.notify_all();
+			throw;
+		}
+		lock.lock();
+
+		const auto prefix_end = stream_staged.begin()->second;
+		stream_staged.erase(stream_staged.begin());
+		if(prefix_end > emit_end) {
+			stream_staged[emit_end] = prefix_end;
+		}
+		stream_begin = emit_end;
+		stream_emitting = false;
+		num_stream_emit++;
+		stream_signal.notify_all();
+		return true;
+	}
+
+	/*
+	 * Write out all staged data (including partial pages and ranges after gaps),
+	 * writes to any gaps will use the normal path afterwards. Requires `stream_mutex` (via `lock`).
+	 */
+	void drain_stream(std::unique_lock<std::mutex>& lock)
+	{
+		stream_draining++;
+		while(stream_emitting || stream_copying) {
+			stream_signal.wait(lock);
+		}
+		const auto staged = std::move(stream_staged);
+		stream_staged.clear();
+		stream_emitting = true;
+		lock.unlock();
+
+		std::exception_ptr error;
+		try {
+			for(const auto& range : staged) {
+				write_stream_range(range.first, range.second);
+			}
+		} catch(...) {
+			error = std::current_exception();
+		}
+		lock.lock();
+		stream_begin = std::max(stream_begin, stream_end);
+		stream_emitting = false;
+		stream_draining--;
+		stream_signal.notify_all();
+
+		if(error) {
+			std::rethrow_exception(error);
+		}
+	}
+
+	// write out staged data (if any) before reading, so that reads see all completed writes
+	void drain_staged()
+	{
+		if(stream_window) {
+			std::unique_lock<std::mutex> lock(stream_mutex);
+			if(!stream_staged.empty()) {
+				drain_stream(lock);
+			}
+		}
+	}
+
+	/*
+	 * Write [begin, end) from the ring, whole pages directly, partial pages via cache.
+	 */
+	void write_stream_range(const uint64_t begin, const uint64_t end)
+	{
+		uint64_t pos = begin;
+		while(pos < end) {
+			const auto ring_pos = pos % stream_window;
+			auto count = std::min(end - pos, stream_window - ring_pos);
+			if((pos & align_mask) || count < page_size) {
+				count = std::min<uint64_t>(count, page_size - (pos & align_mask));
+				write_cached(stream_ring.data() + ring_pos, count, pos);
+			} else {
+				count &= ~uint64_t(align_mask);
+				write_aligned(stream_ring.data() + ring_pos, count, pos);
+			}
+			pos += count;
+		}
+	}
+
+	/*
+	 * Implementation of read(), `tmp` needs to hold `buffer_size` bytes (page aligned).
+	 * If `data` has the same alignment as `offset`, whole pages are read directly into `data`,
+	 * only a partial head / tail page goes through `tmp`.
+	 */
+	void read_impl(void* data, const size_t length, const uint64_t offset, uint8_t* tmp, const bool stream)
+	{
+		const uint64_t max_span = std::max<uint64_t>(buffer_size & ~uint64_t(align_mask), page_size);
+		const bool zero_copy = ((uintptr_t(data) - offset) & align_mask) == 0;
+
+		auto dst = (uint8_t*)data;
+		uint64_t pos = offset;
+		uint64_t left = length;
+		while(left)
+		{
+			if(zero_copy && (pos & align_mask) == 0 && left >= page_size) {
+				const auto count = left & ~uint64_t(align_mask);
+				read_aligned(dst, pos, count, stream);
+				dst += count;
+				pos += count;
+				left -= count;
+				continue;
+			}
+			const auto begin = pos & ~uint64_t(align_mask);
+			const auto end = std::min(align_up(pos + left), begin + (zero_copy ? page_size : max_span));
+
+			read_aligned(tmp, begin, end - begin, stream);
+
+			const auto count = std::min(left, end - pos);
+			::memcpy(dst, tmp + (pos - begin), count);
+			dst += count;
+			pos += count;
+			left -= count;
+		}
+	}
+
+	/*
+	 * Read pages from device into `dst` (or read cache), then apply any cached pages on top.
+	 * Only small reads are inserted into the read cache.
+	 * `offset` and `length` need to be page aligned, as well as `dst` when using Direct IO.
+	 * @param stream If part of a sequential / strided stream, read cache hits don't count as re-use.
+	 */
+	void read_aligned(uint8_t* dst, const uint64_t offset, const uint64_t length, const bool stream = false)
+	{
+		drain_staged();
+
+		const auto begin = offset >> log_page_size;
+		const auto end = (offset + length) >> log_page_size;
+		if(!write_flag && !read_cache) {
+			// nothing cached, no need to lock
+			const auto total = read_device(dst, offset, length);
+			num_read_direct.fetch_add(1, std::memory_order_relaxed);
+			bytes_read_direct.fetch_add(total, std::memory_order_relaxed);
+			return;
+		}
+		const bool use_cache = bool(read_cache);
+		const bool do_insert = use_cache && length <= align_up(read_cache_max_run) + page_size;
+
+		while(true) {
+			uint64_t read_begin = begin;
+			uint64_t read_end = end;
+			uint64_t sequence = 0;
+			const uint64_t flush_count = flush_sequence;
+
+			if(use_cache) {
+				const auto lock = acquire_lock();
+				read_begin = end;
+				read_end = begin;
+				for(auto index = begin; index < end; ++index) {
+					if(cache.count(index)) {
+						continue;	// applied below
+					}
+					if(const auto page = read_cache->find(index, !stream)) {
+						::memcpy(dst + ((index - begin) << log_page_size), page, page_size);
+					} else {
+						read_begin = std::min(read_begin, index);
+						read_end = index + 1;
+					}
+				}
+				sequence = write_sequence;
+			}
+			uint64_t total = 0;
+			if(read_begin < read_end) {
+				total = read_device(dst + ((read_begin - begin) << log_page_size),
+									read_begin << log_page_size, (read_end - read_begin) << log_page_size);
+			}
+			const auto lock = acquire_lock();
+			if(read_begin < read_end) {
+				stats.num_read++;
+				stats.bytes_read += total;
+			}
+			if(flush_sequence != flush_count) {
+				continue;	// pages moved from cache to device while reading, might have missed them
+			}
+			if(do_insert && sequence == write_sequence) {
+				insert_read_cache(dst + ((read_begin - begin) << log_page_size), read_begin, read_end);
+			}
+			for(auto iter = cache.lower_bound(begin); iter != cache.end() && iter->first < end; ++iter) {
+				::memcpy(dst + ((iter->first - begin) << log_page_size), iter->second, page_size);
+			}
+			break;
+		}
+	}
+
+	/*
+	 * Insert clean pages [begin, end) from `src` into read cache, skipping pages already cached, requires lock.
+	 * @param hot If to insert as frequently used (see ReadCache::insert())
+	 */
+	void insert_read_cache(const uint8_t* src, const uint64_t begin, const uint64_t end, const bool hot = false)
+	{
+		std::vector<uint8_t*> evicted;
+		for(auto index = begin; index < end; ++index) {
+			if(!cache.count(index) && !read_cache->contains(index)) {
+				const auto page = alloc_page();
+				::memcpy(page, src + ((index - begin) << log_page_size), page_size);
+				read_cache->insert(index, page, evicted, hot);
+			}
+		}
+		for(auto page : evicted) {
+			free_page(page);
+		}
+	}
+
+	/*
+	 * Load pages [begin, end) into read cache, unless cached already.
+	 */
+	void load_pages(uint64_t begin, uint64_t end, const bool hot = false)
+	{
+		uint64_t sequence = 0;
+		const uint64_t flush_count = flush_sequence;
+		{
+			const auto lock = acquire_lock();
+			while(begin < end && (cache.count(begin) || read_cache->contains(begin))) {
+				begin++;
+			}
+			while(begin < end && (cache.count(end - 1) || read_cache->contains(end - 1))) {
+				end--;
+			}
+			sequence = write_sequence;
+		}
+		if(begin >= end) {
+			return;
+		}
+		const auto length = (end - begin) << log_page_size;
+		const auto tmp = get_thread_buffer(length);
+		const auto total = read_device(tmp, begin << log_page_size, length);
+
+		const auto lock = acquire_lock();
+		stats.num_read_ahead++;
+		stats.bytes_read_ahead += total;
+
+		if(sequence == write_sequence && flush_sequence == flush_count) {
+			insert_read_cache(tmp, begin, end, hot);
+		}
+	}
+
+	/*
+	 * Load pages [begin, end) into read cache asynchronously, unless too much is in flight already.
+	 */
+	void read_ahead(const uint64_t begin, const uint64_t end)
+	{
+		const auto length = (end - begin) << log_page_size;
+		if(pending_read_ahead + length > 4 * std::max<uint64_t>(max_read_ahead, buffer_size)) {
+			return;
+		}
+		pending_read_ahead += length;
+
+		get_pool().add_task([this, begin, end, length]() {
+			try {
+				load_pages(begin, end);
+			} catch(...) {
+				// ignore, read() will report any error
+			}
+			pending_read_ahead -= length;
+		});
+	}
+
+	/*
+	 * Detects sequential / strided read() streams and issues asynchronous read-ahead into the read cache.
+	 * The window starts at 64 KiB and doubles each time the reader consumes half of it, up to `max_read_ahead`.
+	 * Returns true if the access is part of a stream.
+	 */
+	bool check_read_ahead(buffer_t::stream_t& s, const uint64_t offset, const size_t length)
+	{
+		const auto advice = has_advice ? get_advice(offset) : ADVISE_NORMAL;
+		const bool sequential = offset == s.last_end || advice == ADVISE_SEQUENTIAL;
+		const auto stride = int64_t(offset - s.last_offset);
+
+		if(sequential ? s.sequential : (stride == s.stride && stride)) {
+			s.count++;
+		} else {
+			s.sequential = sequential;
+			s.stride = stride;
+			s.count = 0;
+			s.window = 0;
+			s.ahead = 0;
+		}
+		s.last_offset = offset;
+		s.last_end = offset + length;
+
+		if(advice == ADVISE_SEQUENTIAL) {
+			s.count = std::max(s.count, 2);
+		}
+		if(s.count < 2 || !read_cache || length > read_cache_max_run || advice == ADVISE_RANDOM) {
+			return false;
+		}
+		// keep read-ahead within the small queue of the read cache, so it does not evict itself
+		const uint64_t max_window = std::min<uint64_t>(max_read_ahead, (read_cache->get_small_capacity() << log_page_size) / 2);
+		if(max_window < page_size) {
+			return true;
+		}
+		if(!s.window) {
+			s.window = advice == ADVISE_SEQUENTIAL ? max_window : std::min<uint64_t>(64 * 1024, max_window);
+		}
+		const uint64_t max_chunk = std::max<uint64_t>(buffer_size >> log_page_size, 1);
+
+		if(s.sequential) {
+			const auto end = offset + length;
+			if(s.ahead < end) {
+				s.ahead = align_up(end);	// reader overtook read-ahead
+			}
+			if(s.ahead - end <= s.window / 2) {
+				const auto target = align_up(end + s.window);
+				for(auto index = s.ahead >> log_page_size; index < (target >> log_page_size);) {
+					const auto next = std::min(index + max_chunk, target >> log_page_size);
+					read_ahead(index, next);
+					index = next;
+				}
+				s.ahead = target;
+				s.window = std::min(s.window * 2, max_window);
+			}
+		} else {
+			// load the next blocks at offset + k * stride, covering `window` bytes
+			const auto num_items = std::max<uint64_t>(s.window / align_up(length + page_size - 1), 1);
+			const auto get_index = [&](const uint64_t pos) -> int64_t {
+				return (int64_t(pos) - int64_t(offset)) / s.stride;
+			};
+			if(!s.ahead || get_index(s.ahead) < 1) {
+				s.ahead = offset + s.stride;
+			}
+			if(uint64_t(get_index(s.ahead)) <= num_items / 2) {
+				while(uint64_t(get_index(s.ahead)) <= num_items) {
+					if(int64_t(s.ahead) < 0) {
+						break;
+					}
+					const auto begin = s.ahead >> log_page_size;
+					const auto end = (align_up(s.ahead + length)) >> log_page_size;
+					read_ahead(begin, end);
+					s.ahead += s.stride;
+				}
+				s.window = std::min(s.window * 2, max_window);
+			}
+		}
+		return true;
+	}
+
+	/*
+	 * Store advice for [begin, end), replacing any previous advice in that range, requires `advice_mutex`.
+	 */
+	void set_advice(const uint64_t begin, const uint64_t end, const advice_e advice)
+	{
+		auto iter = advice_map.lower_bound(begin);
+		if(iter != advice_map.begin()) {
+			auto prev = std::prev(iter);
+			const auto prev_range = prev->second;
+			if(prev_range.first > begin) {
+				prev->second.first = begin;		// truncate
+				if(prev_range.first > end) {
+					advice_map[end] = prev_range;	// keep remainder
+				}
+			}
+		}
+		iter = advice_map.lower_bound(begin);
+		while(iter != advice_map.end() && iter->first < end) {
+			if(iter->second.first > end) {
+				advice_map[end] = iter->second;		// keep remainder
+			}
+			iter = advice_map.erase(iter);
+		}
+		if(advice != ADVISE_NORMAL && begin < end) {
+			advice_map[begin] = std::make_pair(end, advice);
+		}
+	}
+
+	advice_e get_advice(const uint64_t offset)
+	{
+		std::lock_guard<std::mutex> lock(advice_mutex);
+		auto iter = advice_map.upper_bound(offset);
+		if(iter != advice_map.begin()) {
+			--iter;
+			if(offset < iter->second.first) {
+				return iter->second.second;
+			}
+		}
+		return ADVISE_NORMAL;
+	}
+
+	/*
+	 * Returns a page aligned buffer of at least `length` bytes, local to the calling thread.
+	 */
+	uint8_t* get_thread_buffer(const uint64_t length) const
+	{
+		static thread_local std::unique_ptr<buffer_t> tmp;
+		static thread_local uint64_t tmp_size = 0;
+		static thread_local uint64_t tmp_align = 0;
+
+		if(!tmp || tmp_size < length || tmp_align < page_size) {
+			tmp.reset(new buffer_t());
+			tmp_size = length;
+			tmp_align = page_size;
+			tmp->data = (uint8_t*)::aligned_alloc(page_size, tmp_size);
+		}
+		return tmp->data;
+	}
+
+	/*
+	 * Read from device, bytes beyond end of file are zero filled.
+	 * With `sparse_read` only data extents are read, holes are zero filled.
+	 * Returns number of bytes read from file.
+	 */
+	uint64_t read_device(uint8_t* dst, const uint64_t offset, const uint64_t length)
+	{
+		if(!sparse_read) {
+			return read_range(dst, offset, length);
+		}
+		uint64_t total = 0;
+		uint64_t pos = offset;
+		const auto end = offset + length;
+		while(pos < end) {
+			uint64_t data_begin = 0;
+			uint64_t data_end = 0;
+			if(!find_data(pos, data_begin, data_end)) {
+				data_begin = end;		// only hole until end of file
+			}
+			data_begin = std::min(std::max(data_begin & ~uint64_t(align_mask), pos), end);
+			data_end = std::min(align_up(data_end), end);
+
+			if(data_begin > pos) {
+				::memset(dst + (pos - offset), 0, data_begin - pos);
+				bytes_hole.fetch_add(data_begin - pos, std::memory_order_relaxed);
+				pos = data_begin;
+			}
+			if(pos < data_end) {
+				total += read_range(dst + (pos - offset), pos, data_end - pos);
+				pos = data_end;
+			}
+		}
+		return total;
+	}
+
+	/*
+	 * Find data extent at or after `offset`, returns false if there is no more data.
+	 * The last extent found is cached, since writes don't turn data into holes.
+	 */
+	bool find_data(const uint64_t offset, uint64_t& begin, uint64_t& end)
+	{
+		{
+			std::lock_guard<std::mutex> lock(extent_mutex);
+			if(extent_begin <= offset && offset < extent_end) {
+				begin = offset;
+				end = extent_end;
+				return true;
+			}
+		}
+		const auto data = ::lseek(fd, offset, SEEK_DATA);
+		if(data < 0) {
+			if(errno == ENXIO) {
+				return false;
+			}
+			// not supported, read everything
+			begin = offset;
+			end = uint64_t(-1);
+			return true;
+		}
+		const auto hole = ::lseek(fd, data, SEEK_HOLE);
+		begin = data;
+		end = hole < 0 ? uint64_t(-1) : uint64_t(hole);
+
+		std::lock_guard<std::mutex> lock(extent_mutex);
+		extent_begin = begin;
+		extent_end = end;
+		return true;
+	}
+
+	/*
+	 * Read from device, bytes beyond end of file are zero filled.
+	 * Returns number of bytes read from file.
+	 */
+	uint64_t read_range(uint8_t* dst, const uint64_t offset, const uint64_t length)
+	{
+		uint64_t total = 0;
+		while(total < length) {
+			const auto count = length - total;
+			const auto ret = do_pread(dst + total, count, offset + total);
+			if(ret < 0) {
+				throw std::runtime_error("pread() failed with: " + std::string(std::strerror(errno)));
+			}
+			total += ret;
+			if(uint64_t(ret) < count) {
+				::memset(dst + total, 0, length - total);	// end of file
+				break;
+			}
+		}
+		if(!direct_flag && total) {
+			::posix_fadvise(fd, offset, total, POSIX_FADV_DONTNEED);
+		}
+		return total;
+	}
+
+	// buffered mode only: remember [offset, offset + length) as written, see write_behind()
+	void add_dirty(const uint64_t offset, const uint64_t length)
+	{
+		if(direct_flag || !write_behind_bytes) {
+			return;
+		}
+		std::lock_guard<std::mutex> lock(write_behind_mutex);
+		if(dirty_begin < dirty_end) {
+			dirty_begin = std::min(dirty_begin, offset);
+			dirty_end = std::max(dirty_end, offset + length);
+		} else {
+			dirty_begin = offset;
+			dirty_end = offset + length;
+		}
+		dirty_bytes += length;
+	}
+
+	/*
+	 * Emulates Direct IO in buffered mode: after `write_behind_bytes` written, start write-out of the
+	 * range written since, then wait for the previous write-out to finish and drop it from the page cache.
+	 * This keeps at most two windows of dirty / cached data.
+	 * Note: don't call while holding `mutex`, since it waits for the device
+	 */
+	void write_behind()
+	{
+		if(direct_flag || !write_behind_bytes) {
+			return;
+		}
+		uint64_t begin = 0;
+		uint64_t end = 0;
+		uint64_t prev_begin = 0;
+		uint64_t prev_end = 0;
+		{
+			std::lock_guard<std::mutex> lock(write_behind_mutex);
+			if(dirty_bytes < write_behind_bytes) {
+				return;
+			}
+			begin = dirty_begin;
+			end = dirty_end;
+			prev_begin = writeback_begin;
+			prev_end = writeback_end;
+			writeback_begin = dirty_begin;
+			writeback_end = dirty_end;
+			dirty_begin = 0;
+			dirty_end = 0;
+			dirty_bytes = 0;
+			num_write_behind++;
+		}
+		::sync_file_range(fd, begin, end - begin, SYNC_FILE_RANGE_WRITE);
+
+		if(prev_begin < prev_end) {
+			drop_range(prev_begin, prev_end);
+		}
+	}
+
+	void finish_write_behind()
+	{
+		std::vector<std::pair<uint64_t, uint64_t>> ranges;
+		{
+			std::lock_guard<std::mutex> lock(write_behind_mutex);
+			if(writeback_begin < writeback_end) {
+				ranges.emplace_back(writeback_begin, writeback_end);
+			}
+			if(dirty_begin < dirty_end) {
+				ranges.emplace_back(dirty_begin, dirty_end);
+			}
+			writeback_begin = writeback_end = 0;
+			dirty_begin = dirty_end = 0;
+			dirty_bytes = 0;
+		}
+		for(const auto& range : ranges) {
+			drop_range(range.first, range.second);
+		}
+	}
+
+	// wait for write-out of [begin, end) and drop it from the page cache (errors are ignored, it's only advice)
+	void drop_range(const uint64_t begin, const uint64_t end)
+	{
+		::sync_file_range(fd, begin, end - begin,
+				SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+		::posix_fadvise(fd, begin, end - begin, POSIX_FADV_DONTNEED);
+	}
+
+	static int64_t get_time_ns() {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	/*
+	 * Locks `mutex`, measuring the time spent waiting when contended.
+	 */
+	std::unique_lock<std::mutex> acquire_lock()
+	{
+		std::unique_lock<std::mutex> lock(mutex, std::try_to_lock);
+		if(!lock) {
+			MAD_PROBE0(lock_wait_entry);
+
+			const auto detail = get_detail_trace();
+			const auto detail_begin = detail ? detail->now() : 0;
+			const auto time_begin = std::chrono::steady_clock::now();
+			lock.lock();
+			const uint64_t wait_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+					std::chrono::steady_clock::now() - time_begin).count();
+			stats.num_lock_wait++;
+			stats.lock_wait_ns += wait_ns;
+
+			MAD_PROBE1(lock_wait_exit, wait_ns);
+			if(detail) {
+				detail->record(IOTrace::OP_LOCK_WAIT, 0, 0, detail_begin);
+			}
+		}
+		return lock;
+	}
+
+	/*
+	 * Same as acquire_lock(), but if `would_block` is not null only tries to lock,
+	 * returning an unlocked lock and setting `*would_block` to true on contention.
+	 */
+	std::unique_lock<std::mutex> acquire_lock(bool* would_block)
+	{
+		if(!would_block) {
+			return acquire_lock();
+		}
+		std::unique_lock<std::mutex> lock(mutex, std::try_to_lock);
+		if(!lock) {
+			*would_block = true;
+		}
+		return lock;
+	}
+
+	uint8_t* get_page(const uint64_t address)
+	{
+		const auto index = address >> log_page_size;
+		auto& page = cache[index];
+		if(!page) {
+			write_sequence++;
+			if(read_cache && (page = read_cache->erase(index))) {
+				if(pinned_pages.count(page)) {
+					// still used by a view, need a copy
+					const auto copy = alloc_page();
+					::memcpy(copy, page, page_size);
+					free_page(page);
+					page = copy;
+				}
+				return page;	// clean copy is up to date
+			}
+			page = alloc_page();
+			MAD_PROBE1(page_alloc, index);
+
+			if(read_flag) {
+				MAD_PROBE1(page_read_entry, index);
+				const auto ret = do_pread(page, page_size, index * page_size);
+				MAD_PROBE2(page_read_exit, index, ret);
+				stats.num_pread++;
+				if(ret <= 0) {
+					::memset(page, 0, page_size);
+				} else {
+					::memset(page + ret, 0, page_size - ret);
+				}
+			} else {
+				::memset(page, 0, page_size);
+			}
+		}
+		return page;
+	}
+
+	void flush_page(const uint64_t index, uint8_t*& page)
+	{
+		if(do_pwrite(page, page_size, index * page_size) != ssize_t(page_size)) {
+			throw std::runtime_error("pwrite() on flush failed with: " + std::string(std::strerror(errno)));
+		}
+		stats.num_pwrite_flush++;
+
+		add_dirty(index * page_size, page_size);		// write-out happens after unlock, see write_behind()
+
+		MAD_PROBE1(flush_page, index);
+		free_page(page);
+		page = nullptr;
+	}
+
+	/*
+	 * Wait for rate limits (if any) before writing `bytes` in `ops` writes to device.
+	 * If `would_block` is not null only proceeds without waiting, otherwise sets it to true and returns false.
+	 */
+	bool throttle(const uint64_t bytes, const uint64_t ops = 1, bool* would_block = nullptr)
+	{
+		if(!rate_limiter && !device_limiter) {
+			return true;
+		}
+		if(would_block) {
+			if(rate_limiter && !rate_limiter->try_acquire(bytes, ops)) {
+				*would_block = true;
+				return false;
+			}
+			if(device_limiter && !device_limiter->try_acquire(bytes, ops)) {
+				if(rate_limiter) {
+					rate_limiter->release(bytes, ops);
+				}
+				*would_block = true;
+				return false;
+			}
+			return true;
+		}
+		uint64_t wait_ns = 0;
+		if(rate_limiter) {
+			wait_ns += rate_limiter->acquire(bytes, ops);
+		}
+		if(device_limiter) {
+			wait_ns += device_limiter->acquire(bytes, ops);
+		}
+		if(wait_ns) {
+			num_throttled++;
+			throttle_ns += wait_ns;
+		}
+		return true;
+	}
+
+	// return tokens taken by throttle() for writes that didn't happen
+	void unthrottle(const uint64_t bytes, const uint64_t ops = 1)
+	{
+		if(rate_limiter) {
+			rate_limiter->release(bytes, ops);
+		}
+		if(device_limiter) {
+			device_limiter->release(bytes, ops);
+		}
+	}
+
+	/*
+	 * Wait for rate limits for flushing all currently cached pages, before taking the lock,
+	 * such that flush_no_lock() never sleeps while holding it. Returns number of pages reserved.
+	 * Nothing is reserved if the cache is below `min_bytes`, since another thread flushed it already.
+	 * Requires `flush_mutex`, such that only one thread pays for the same pages.
+	 */
+	size_t reserve_flush(const uint64_t min_bytes = 0)
+	{
+		if(!rate_limiter && !device_limiter) {
+			return 0;
+		}
+		size_t count = 0;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			count = cache.size();
+		}
+		if(count * page_size < min_bytes) {
+			return 0;
+		}
+		throttle(count * page_size, count);		// also waits for any debt when empty
+		return count;
+	}
+
+	/*
+	 * Account for `count` flushed pages of which `reserved` were paid by reserve_flush() already,
+	 * additional pages are charged without waiting (paid for by following writes).
+	 */
+	void settle_flush(const size_t count, const size_t reserved)
+	{
+		if(count > reserved) {
+			if(rate_limiter) {
+				rate_limiter->charge((count - reserved) * page_size, count - reserved);
+			}
+			if(device_limiter) {
+				device_limiter->charge((count - reserved) * page_size, count - reserved);
+			}
+		} else if(count < reserved) {
+			unthrottle((reserved - count) * page_size, reserved - count);
+		}
+	}
+
+	/*
+	 * Page pool shared by write and read cache, requires lock.
+	 */
+	uint8_t* alloc_page()
+	{
+		if(!free_pages.empty()) {
+			const auto page = free_pages.back();
+			free_pages.pop_back();
+			return page;
+		}
+		return (uint8_t*)::aligned_alloc(page_size, page_size);
+	}
+
+	void free_page(uint8_t* page)
+	{
+		if(!pinned_pages.empty()) {
+			auto iter = pinned_pages.find(page);
+			if(iter != pinned_pages.end()) {
+				iter->second |= orphan_flag;	// free when last view is dropped
+				return;
+			}
+		}
+		if(free_pages.size() * page_size < max_free_bytes) {
+			free_pages.push_back(page);
+		} else {
+			::free(page);
+		}
+	}
+
+	void unpin_page(uint8_t* page)
+	{
+		const auto lock = acquire_lock();
+		auto iter = pinned_pages.find(page);
+		if(iter != pinned_pages.end() && ((--iter->second) & ~orphan_flag) == 0) {
+			const bool orphan = iter->second & orphan_flag;
+			pinned_pages.erase(iter);
+			if(orphan) {
+				free_page(page);
+			}
+		}
+	}
+
+	/*
+	 * Buffers for read_view(), pooled if not larger than `buffer_size`.
+	 */
+	uint8_t* alloc_view_buffer(const size_t size)
+	{
+		if(size <= buffer_size) {
+			std::lock_guard<std::mutex> lock(view_mutex);
+			if(!free_views.empty()) {
+				const auto buffer = free_views.back();
+				free_views.pop_back();
+				return buffer;
+			}
+		}
+		const auto buffer = (uint8_t*)::aligned_alloc(page_size, std::max<size_t>(size, buffer_size));
+		if(!buffer) {
+			throw std::bad_alloc();
+		}
+		return buffer;
+	}
+
+	void free_view_buffer(uint8_t* buffer, const size_t size)
+	{
+		if(size <= buffer_size) {
+			std::lock_guard<std::mutex> lock(view_mutex);
+			if(free_views.size() * buffer_size < max_free_bytes) {
+				free_views.push_back(buffer);
+				return;
+			}
+		}
+		::free(buffer);
+	}
+
+	/*
+	 * Drop read cache pages in [begin, end), requires lock.
+	 */
+	void invalidate_read_cache(const uint64_t begin, const uint64_t end)
+	{
+		write_sequence++;
+		if(read_cache) {
+			for(auto index = begin; index < end; ++index) {
+				if(const auto page = read_cache->erase(index)) {
+					free_page(page);
+				}
+			}
+		}
+	}
+
+	/*
+	 * Auto flush with tuning of the threshold, based on overall write throughput between flushes.
+	 */
+	void auto_flush()
+	{
+		std::lock_guard<std::mutex> flush_lock(flush_mutex);
+		const auto reserved = reserve_flush(flush_bytes);
+		const auto lock = acquire_lock();
+
+		if(cache.size() * page_size < flush_bytes) {
+			unthrottle(reserved * page_size, reserved);
+			return;		// another thread was faster
+		}
+		flush_no_lock(reserved);
+
+		const auto now = get_time_ns();
+		const auto bytes = stats.bytes_direct + stats.bytes_cached;
+		if(flush_tuner->add_sample(bytes - tune_last_bytes, now - tune_last_time)) {
+			flush_bytes = flush_tuner->get_value();
+		}
+		tune_last_bytes = bytes;
+		tune_last_time = now;
+	}
+
+	/*
+	 * Write out all cached pages, requires lock.
+	 * @param reserved Number of pages already paid for via reserve_flush()
+	 */
+	void flush_no_lock(const size_t reserved = 0)
+	{
+		const auto detail = cache.empty() ? nullptr : get_detail_trace();
+		const auto detail_begin = detail ? detail->now() : 0;
+		const auto count = cache.size();
+
+		if(!cache.empty()) {
+			stats.num_flush++;
+		}
+		MAD_PROBE1(flush_entry, count);
+
+		for(auto& entry : cache) {
+			flush_page(entry.first, entry.second);
+		}
+		settle_flush(count, reserved);
+
+		if(!cache.empty()) {
+			flush_sequence++;
+		}
+		cache.clear();
+
+		MAD_PROBE1(flush_exit, count);
+
+		if(detail) {
+			detail->record(IOTrace::OP_FLUSH_CACHE, 0, count * page_size, detail_begin);
+		}
+
+		read_flag = true;
+	}
+
+private:
+	bool read_flag;
+	const bool write_flag;
+	const int log_page_size;
+	const uint32_t page_size;
+	const uint32_t align_mask;
+	const size_t buffer_size;
+
+	int fd = -1;
+	bool direct_flag = false;
+
+	std::mutex mutex;
+	std::map<uint64_t, uint8_t*> cache;
+
+	std::mutex flush_mutex;		// serializes reserve_flush() + flush_no_lock(), locked before `mutex`
+
+	std::unique_ptr<ReadCache> read_cache;
+	size_t read_cache_max_run = 0;
+	uint64_t write_sequence = 0;		// incremented when pages are modified, see read_aligned()
+	std::atomic<uint64_t> flush_sequence {0};	// incremented after flushing pages, see read_aligned()
+
+	std::vector<uint8_t*> free_pages;
+	static constexpr size_t max_free_bytes = 4 * 1024 * 1024;
+
+	// read cache pages used by views [page => count | orphan_flag]
+	std::unordered_map<const uint8_t*, uint32_t> pinned_pages;
+	static constexpr uint32_t orphan_flag = uint32_t(1) << 31;
+
+	std::mutex view_mutex;
+	std::vector<uint8_t*> free_views;
+
+	std::atomic<uint64_t> pending_read_ahead {0};		// bytes in flight
+
+	std::mutex stream_mutex;
+	std::condition_variable stream_signal;
+	aligned_buffer_t stream_ring;
+	uint64_t stream_window = 0;			// ring size (0 = stream mode disabled)
+	uint64_t stream_begin = 0;			// everything before is written out (or skipped)
+	uint64_t stream_end = 0;			// max end of staged data
+	std::map<uint64_t, uint64_t> stream_staged;		// completed ranges in ring [begin => end]
+	bool stream_emitting = false;
+	uint64_t stream_emit_end = 0;		// end of range being written out by try_emit()
+	int stream_draining = 0;
+	int stream_copying = 0;
+	int stream_waiting = 0;
+	uint64_t num_stream_emit = 0;
+	uint64_t num_stream_wait = 0;
+
+	std::mutex write_behind_mutex;
+	uint64_t dirty_begin = 0;			// range written since last write-out
+	uint64_t dirty_end = 0;
+	uint64_t dirty_bytes = 0;
+	uint64_t writeback_begin = 0;		// range of last write-out
+	uint64_t writeback_end = 0;
+	uint64_t num_write_behind = 0;
+
+	std::mutex extent_mutex;
+	uint64_t extent_begin = 0;		// last data extent found, see find_data()
+	uint64_t extent_end = 0;
+	std::atomic<uint64_t> bytes_hole {0};
+
+	std::mutex advice_mutex;
+	std::atomic<bool> has_advice {false};
+	std::map<uint64_t, std::pair<uint64_t, advice_e>> advice_map;		// [begin => [end, advice]]
+
+	stats_t stats;
+	std::atomic<uint64_t> num_read_direct {0};		// reads without lock in read-only mode
+	std::atomic<uint64_t> bytes_read_direct {0};
+
+	std::unique_ptr<AutoTuner> chunk_tuner;
+	std::unique_ptr<AutoTuner> flush_tuner;
+	std::atomic<size_t> chunk_size {0};
+	std::atomic<size_t> flush_bytes {0};
+	uint64_t tune_last_bytes = 0;
+	int64_t tune_last_time = 0;
+
+	std::mutex completion_mutex;
+	int completion_fd = -1;			// eventfd, created on first get_completion_fd()
+	std::atomic<uint64_t> num_write_deferred {0};
+
+	std::unique_ptr<RateLimiter> rate_limiter;
+	std::shared_ptr<RateLimiter> device_limiter;
+	std::atomic<uint64_t> num_throttled {0};
+	std::atomic<uint64_t> throttle_ns {0};
+	std::atomic<bool> nowait_failed {false};		// RWF_NOWAIT not supported, see try_write()
+	size_t num_in_flight = 0;
+	std::deque<completion_t> completions;
+	std::vector<std::unique_ptr<buffer_t>> async_buffers;
+
+	std::mutex pool_mutex;
+	std::unique_ptr<ThreadPool> pool;
 
 };
 
@@ -0,0 +1,316 @@
+/*
+ * IOTrace.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: mad
+ */
+
+#ifndef INCLUDE_IOTRACE_H_
+#define INCLUDE_IOTRACE_H_
+
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <chrono>
+#include <stdexcept>
+#include <algorithm>
+
+#include <cstdio>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+
+namespace mad {
+
+/*
+ * Compact binary recorder of I/O operations, with one ring buffer per thread.
+ * When a ring is full the oldest records of that thread are overwritten.
+ * Rings are allocated in chunks as they fill, to keep the cost of the first records low.
+ */
+class IOTrace {
+public:
+	enum op_e : uint8_t {
+		OP_WRITE = 1,
+		OP_FLUSH = 2,
+		// internal events, only recorded with `detail`
+		OP_CACHE_WRITE = 16,		// head / tail copy into page cache
+		OP_PWRITE = 17,				// aligned pwrite()
+		OP_FLUSH_CACHE = 18,		// writing out cached pages
+		OP_LOCK_WAIT = 19,			// waiting for contended lock
+	};
+
+	struct record_t {
+		uint64_t offset = 0;
+		uint64_t length = 0;
+		uint64_t time = 0;			// begin [ns] since trace start
+		uint32_t duration = 0;		// [ns]
+		uint16_t thread = 0;		// index in order of first record
+		uint8_t op = 0;
+		uint8_t flags = 0;
+	};
+
+	/*
+	 * @param capacity Number of records per thread.
+	 */
+	IOTrace(const size_t capacity = 1024 * 1024)
+		:	capacity(std::max<size_t>(capacity, 1))
+	{
+		static std::atomic<uint64_t> next_id {1};
+		id = next_id++;
+		time_begin = std::chrono::steady_clock::now();
+	}
+
+	// enable recording of internal events, for timeline analysis
+	bool detail = false;
+
+	IOTrace(const IOTrace&) = delete;
+	IOTrace& operator=(const IOTrace&) = delete;
+
+	~IOTrace() {
+		for(auto& entry : rings) {
+			delete entry.second;
+		}
+	}
+
+	// current time [ns] since trace start
+	uint64_t now() const {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - time_begin).count();
+	}
+
+	/*
+	 * Note: thread-safe
+	 */
+	void record(const op_e op, const uint64_t offset, const uint64_t length, const uint64_t time, const uint8_t flags = 0)
+	{
+		auto& ring = get_ring();
+
+		auto& out = ring.get(ring.count % capacity);
+		out.offset = offset;
+		out.length = length;
+		out.time = time;
+		out.duration = std::min<uint64_t>(now() - time, UINT32_MAX);
+		out.thread = ring.thread;
+		out.op = op;
+		out.flags = flags;
+
+		ring.count++;
+	}
+
+	/*
+	 * Returns all records sorted by begin time.
+	 * Note: NOT thread-safe with record()
+	 */
+	std::vector<record_t> get_records() const
+	{
+		std::vector<record_t> out;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			for(const auto& entry : rings) {
+				const auto& ring = *entry.second;
+				const auto count = std::min<uint64_t>(ring.count, capacity);
+				for(uint64_t i = ring.count - count; i < ring.count; ++i) {
+					out.push_back(ring.get(i % capacity));
+				}
+			}
+		}
+		std::stable_sort(out.begin(), out.end(),
+			[](const record_t& L, const record_t& R) -> bool {
+				return L.time < R.time;
+			});
+		return out;
+	}
+
+	// number of records lost due to ring overflow
+	uint64_t get_num_dropped() const
+	{
+		uint64_t total = 0;
+		std::lock_guard<std::mutex> lock(mutex);
+		for(const auto& entry : rings) {
+			const auto& ring = *entry.second;
+			if(ring.count > capacity) {
+				total += ring.count - capacity;
+			}
+		}
+		return total;
+	}
+
+	/*
+	 * Write binary trace file.
+	 * Note: NOT thread-safe with record()
+	 */
+	void save(const std::string& file_path) const
+	{
+		const auto records = get_records();
+
+		FILE* file = ::fopen(file_path.c_str(), "wb");
+		if(!file) {
+			throw std::runtime_error("fopen() failed with: " + std::string(std::strerror(errno)));
+		}
+		header_t header;
+		header.count = records.size();
+		header.num_dropped = get_num_dropped();
+
+		bool fail = ::fwrite(&header, sizeof(header), 1, file) != 1;
+		if(!records.empty()) {
+			fail = fail || ::fwrite(records.data(), sizeof(record_t), records.size(), file) != records.size();
+		}
+		if(::fclose(file) || fail) {
+			throw std::runtime_error("failed to write trace: " + file_path);
+		}
+	}
+
+	/*
+	 * Write Chrome trace event JSON, to be viewed in Perfetto or chrome://tracing.
+	 * Note: NOT thread-safe with record()
+	 */
+	void save_chrome_trace(const std::string& file_path) const
+	{
+		const auto records = get_records();
+
+		FILE* file = ::fopen(file_path.c_str(), "w");
+		if(!file) {
+			throw std::runtime_error("fopen() failed with: " + std::string(std::strerror(errno)));
+		}
+		uint32_t num_threads = 0;
+		for(const auto& entry : records) {
+			num_threads = std::max<uint32_t>(num_threads, entry.thread + 1);
+		}
+		::fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+		for(uint32_t i = 0; i < num_threads; ++i) {
+			::fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"thread %u\"}},\n", i, i);
+		}
+		for(size_t i = 0; i < records.size(); ++i) {
+			const auto& entry = records[i];
+			::fprintf(file, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,"
+					"\"args\":{\"offset\":%llu,\"length\":%llu}}%s\n",
+					get_op_name(entry.op), unsigned(entry.thread), entry.time / 1e3, entry.duration / 1e3,
+					(unsigned long long)entry.offset, (unsigned long long)entry.length,
+					i + 1 < records.size() ? "," : "");
+		}
+		::fprintf(file, "]}\n");
+
+		if(::fclose(file)) {
+			throw std::runtime_error("failed to write trace: " + file_path);
+		}
+	}
+
+	static const char* get_op_name(const uint8_t op)
+	{
+		switch(op) {
+			case OP_WRITE: return "write";
+			case OP_FLUSH: return "flush";
+			case OP_CACHE_WRITE: return "cache_write";
+			case OP_PWRITE: return "pwrite";
+			case OP_FLUSH_CACHE: return "flush_cache";
+			case OP_LOCK_WAIT: return "lock_wait";
+		}
+		return "unknown";
+	}
+
+	/*
+	 * Read binary trace file, as written by save().
+	 * @param num_dropped Optional output for number of records lost while tracing (see get_num_dropped())
+	 */
+	static std::vector<record_t> load(const std::string& file_path, uint64_t* num_dropped = nullptr)
+	{
+		FILE* file = ::fopen(file_path.c_str(), "rb");
+		if(!file) {
+			throw std::runtime_error("fopen() failed with: " + std::string(std::strerror(errno)));
+		}
+		header_t header;
+		std::vector<record_t> records;
+		try {
+			// version 1 has no `num_dropped`
+			const header_t expect;
+			const size_t header_v1 = offsetof(header_t, num_dropped);
+			if(::fread(&header, header_v1, 1, file) != 1
+				|| ::memcmp(header.magic, expect.magic, sizeof(header.magic))
+				|| header.version < 1 || header.version > expect.version || header.record_size != sizeof(record_t)
+				|| (header.version > 1 && ::fread(&header.num_dropped, sizeof(header) - header_v1, 1, file) != 1))
+			{
+				throw std::runtime_error("invalid trace file: " + file_path);
+			}
+			if(num_dropped) {
+				*num_dropped = header.num_dropped;
+			}
+			records.resize(header.count);
+			if(::fread(records.data(), sizeof(record_t), records.size(), file) != records.size()) {
+				throw std::runtime_error("truncated trace file: " + file_path);
+			}
+		} catch(...) {
+			::fclose(file);
+			throw;
+		}
+		::fclose(file);
+		return records;
+	}
+
+private:
+	struct header_t {
+		char magic[8] = {'M', 'A', 'D', 'T', 'R', 'A', 'C', 'E'};
+		uint32_t version = 2;
+		uint32_t record_size = sizeof(record_t);
+		uint64_t count = 0;
+		uint64_t num_dropped = 0;
+	};
+
+	static constexpr size_t chunk_size = 1024;		// records
+
+	struct ring_t {
+		std::vector<std::unique_ptr<record_t[]>> chunks;
+		uint64_t count = 0;
+		uint16_t thread = 0;
+
+		// returns record at `index`, allocates its chunk on first access
+		record_t& get(const uint64_t index)
+		{
+			const auto chunk = index / chunk_size;
+			if(chunk >= chunks.size()) {
+				chunks.emplace_back(new record_t[chunk_size]);
+			}
+			return chunks[chunk][index % chunk_size];
+		}
+		const record_t& get(const uint64_t index) const {
+			return chunks[index / chunk_size][index % chunk_size];
+		}
+	};
+
+	ring_t& get_ring()
+	{
+		// cache last ring used by this thread, ids are never re-used
+		static thread_local uint64_t cache_id = 0;
+		static thread_local ring_t* cache_ring = nullptr;
+
+		if(cache_id != id) {
+			std::lock_guard<std::mutex> lock(mutex);
+			auto& ring = rings[std::this_thread::get_id()];
+			if(!ring) {
+				ring = new ring_t();
+				ring->chunks.reserve((capacity + chunk_size - 1) / chunk_size);
+				ring->thread = rings.size() - 1;
+			}
+			cache_id = id;
+			cache_ring = ring;
+		}
+		return *cache_ring;
+	}
+
+	const size_t capacity;
+
+	uint64_t id = 0;
+	std::chrono::steady_clock::time_point time_begin;
+
+	mutable std::mutex mutex;
+	std::map<std::thread::id, ring_t*> rings;
+
+};
+
+
+} // mad
+
+#endif /* INCLUDE_IOTRACE_H_ */
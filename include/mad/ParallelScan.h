@@ -0,0 +1,120 @@
+/*
+ * ParallelScan.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: mad
+ */
+
+#ifndef INCLUDE_PARALLELSCAN_H_
+#define INCLUDE_PARALLELSCAN_H_
+
+#include <mad/DirectFile.h>
+
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <exception>
+#include <functional>
+#include <condition_variable>
+
+
+namespace mad {
+
+/*
+ * Reads the whole file once in chunks of `chunk_size` (rounded up to page size), using `num_threads`
+ * threads with one read in flight each, and calls `callback(data, length, offset)` for every chunk.
+ * The last chunk may be shorter. Reads go directly into aligned per-thread buffers (see DirectFile::read()).
+ * @param ordered If to invoke `callback` in order of offset (one at a time), otherwise concurrently.
+ * Re-throws the first exception thrown by a read or `callback`, remaining chunks are skipped.
+ */
+inline
+void parallel_scan(	DirectFile& file, size_t chunk_size, const int num_threads,
+					const std::function<void(const uint8_t* data, size_t length, uint64_t offset)>& callback,
+					const bool ordered = false)
+{
+	const auto page_size = file.get_page_size();
+	chunk_size = std::max<size_t>((chunk_size + page_size - 1) / page_size, 1) * page_size;
+
+	const auto file_size = file.get_file_size();
+	const auto num_chunks = (file_size + chunk_size - 1) / chunk_size;
+
+	std::mutex mutex;
+	std::condition_variable signal;
+	std::atomic<uint64_t> next {0};
+	uint64_t next_emit = 0;
+	bool failed = false;
+	std::exception_ptr error;
+
+	const auto fail = [&]() {
+		std::lock_guard<std::mutex> lock(mutex);
+		if(!error) {
+			error = std::current_exception();
+		}
+		failed = true;
+		signal.notify_all();
+	};
+
+	const auto worker = [&]()
+	{
+		DirectFile::buffer_t buffer;
+		auto tmp = file.alloc_buffer(chunk_size);
+		while(true) {
+			const auto index = next++;
+			if(index >= num_chunks) {
+				break;
+			}
+			const auto offset = index * chunk_size;
+			const auto length = std::min<uint64_t>(chunk_size, file_size - offset);
+			try {
+				file.read(tmp.data(), length, offset, buffer);
+			} catch(...) {
+				fail();
+				break;
+			}
+			if(ordered) {
+				std::unique_lock<std::mutex> lock(mutex);
+				while(!failed && next_emit != index) {
+					signal.wait(lock);
+				}
+				if(failed) {
+					break;
+				}
+			}
+			try {
+				callback(tmp.data(), length, offset);
+			} catch(...) {
+				fail();
+				break;
+			}
+			if(ordered) {
+				std::lock_guard<std::mutex> lock(mutex);
+				next_emit++;
+				signal.notify_all();
+			} else {
+				std::lock_guard<std::mutex> lock(mutex);
+				if(failed) {
+					break;
+				}
+			}
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for(int i = 1; i < std::max(num_threads, 1); ++i) {
+		threads.emplace_back(worker);
+	}
+	worker();
+
+	for(auto& thread : threads) {
+		thread.join();
+	}
+	if(error) {
+		std::rethrow_exception(error);
+	}
+}
+
+
+} // mad
+
+#endif /* INCLUDE_PARALLELSCAN_H_ */
@@ -0,0 +1,47 @@
+/*
+ * Probes.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: mad
+ */
+
+#ifndef INCLUDE_PROBES_H_
+#define INCLUDE_PROBES_H_
+
+/*
+ * USDT static probes for bpftrace / perf / SystemTap, provider `mad_direct_io`.
+ * Each probe compiles to a single nop when not attached.
+ * Enabled when <sys/sdt.h> is available (systemtap-sdt-dev), define MAD_NO_USDT to disable.
+ *
+ * Example:
+ *   bpftrace -e 'usdt:./test_write:mad_direct_io:pwrite_exit { @bytes = hist(arg1); }'
+ *
+ * Probes:
+ *   write_entry(offset, length)           write_exit(offset, length)
+ *   pwrite_entry(offset, length)          pwrite_exit(offset, length)      aligned path
+ *   page_alloc(index)                                                      new page in cache
+ *   page_read_entry(index)                page_read_exit(index, bytes)     read-modify-write in get_page()
+ *   flush_entry(num_pages)                flush_exit(num_pages)            flush_no_lock()
+ *   flush_page(index)                                                      each page written on flush
+ *   lock_wait_entry()                     lock_wait_exit(wait_ns)          contended lock acquisition
+ */
+
+#if !defined(MAD_NO_USDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define MAD_USDT_ENABLED 1
+#endif
+#endif
+
+#ifdef MAD_USDT_ENABLED
+#define MAD_PROBE0(name)				DTRACE_PROBE(mad_direct_io, name)
+#define MAD_PROBE1(name, a)				DTRACE_PROBE1(mad_direct_io, name, a)
+#define MAD_PROBE2(name, a, b)			DTRACE_PROBE2(mad_direct_io, name, a, b)
+#else
+#define MAD_PROBE0(name)				do {} while(0)
+#define MAD_PROBE1(name, a)				do {} while(0)
+#define MAD_PROBE2(name, a, b)			do {} while(0)
+#endif
+
+
+#endif /* INCLUDE_PROBES_H_ */
@@ -0,0 +1,185 @@
+/*
+ * RateLimiter.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: mad
+ */
+
+#ifndef INCLUDE_RATELIMITER_H_
+#define INCLUDE_RATELIMITER_H_
+
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <algorithm>
+
+#include <cstdint>
+#include <cstddef>
+
+
+namespace mad {
+
+/*
+ * Token bucket limiting bytes / sec and operations / sec (IOPS), with a burst allowance of `burst_sec`
+ * worth of tokens. Requests larger than the burst are admitted by going into debt, which later requests pay for,
+ * such that the long term rate is kept without starving large requests.
+ * Note: thread-safe
+ */
+class RateLimiter {
+public:
+	RateLimiter(const uint64_t bytes_per_sec, const uint64_t ops_per_sec = 0, const double burst_sec = 0.1)
+	{
+		set_limit(bytes_per_sec, ops_per_sec, burst_sec);
+	}
+
+	RateLimiter(const RateLimiter&) = delete;
+	RateLimiter& operator=(const RateLimiter&) = delete;
+
+	/*
+	 * Change limits (0 = unlimited), the buckets start full.
+	 */
+	void set_limit(const uint64_t bytes_per_sec, const uint64_t ops_per_sec = 0, const double burst_sec = 0.1)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		byte_rate = bytes_per_sec;
+		op_rate = ops_per_sec;
+		byte_burst = bytes_per_sec * std::max(burst_sec, 0.);
+		op_burst = std::max(ops_per_sec * std::max(burst_sec, 0.), 1.);
+		byte_tokens = byte_burst;
+		op_tokens = op_burst;
+		last_time = get_time_ns();
+	}
+
+	/*
+	 * Take tokens for one operation of `bytes`, sleeping until the rate allows it.
+	 * Returns time spent waiting in ns.
+	 */
+	uint64_t acquire(const uint64_t bytes, const uint64_t ops = 1)
+	{
+		int64_t wait_ns = 0;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			refill();
+			take(bytes, ops);
+			wait_ns = get_wait_ns();
+		}
+		if(wait_ns > 0) {
+			std::this_thread::sleep_for(std::chrono::nanoseconds(wait_ns));
+			return wait_ns;
+		}
+		return 0;
+	}
+
+	/*
+	 * Same as acquire(), but only takes the tokens if there is no need to wait.
+	 * Requests larger than the burst are admitted (into debt) when the bucket is full.
+	 * Returns true on success.
+	 */
+	bool try_acquire(const uint64_t bytes, const uint64_t ops = 1)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		refill();
+		if(	(byte_rate && byte_tokens < std::min<double>(bytes, byte_burst))
+			|| (op_rate && op_tokens < std::min<double>(ops, op_burst)))
+		{
+			return false;
+		}
+		take(bytes, ops);
+		return true;
+	}
+
+	/*
+	 * Take tokens without waiting, going into debt if needed (paid for by following requests).
+	 */
+	void charge(const uint64_t bytes, const uint64_t ops = 1)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		refill();
+		take(bytes, ops);
+	}
+
+	/*
+	 * Give back tokens of an operation that was not executed after all.
+	 */
+	void release(const uint64_t bytes, const uint64_t ops = 1)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		byte_tokens = std::min(byte_tokens + bytes, byte_burst);
+		op_tokens = std::min(op_tokens + ops, op_burst);
+	}
+
+	/*
+	 * Returns shared limiter for device `dev` (see stat::st_dev), created unlimited on first use.
+	 */
+	static std::shared_ptr<RateLimiter> get_device(const uint64_t dev)
+	{
+		static std::mutex registry_mutex;
+		static std::map<uint64_t, std::weak_ptr<RateLimiter>> registry;
+
+		std::lock_guard<std::mutex> lock(registry_mutex);
+		auto limiter = registry[dev].lock();
+		if(!limiter) {
+			limiter = std::make_shared<RateLimiter>(0, 0);
+			registry[dev] = limiter;
+		}
+		return limiter;
+	}
+
+private:
+	static int64_t get_time_ns() {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	// requires lock
+	void refill()
+	{
+		const auto now = get_time_ns();
+		const double delta = (now - last_time) * 1e-9;
+		last_time = now;
+		byte_tokens = std::min(byte_tokens + byte_rate * delta, byte_burst);
+		op_tokens = std::min(op_tokens + op_rate * delta, op_burst);
+	}
+
+	// requires lock
+	void take(const uint64_t bytes, const uint64_t ops)
+	{
+		if(byte_rate) {
+			byte_tokens -= bytes;
+		}
+		if(op_rate) {
+			op_tokens -= ops;
+		}
+	}
+
+	// time until both buckets are out of debt, requires lock
+	int64_t get_wait_ns() const
+	{
+		double wait = 0;
+		if(byte_rate && byte_tokens < 0) {
+			wait = std::max(wait, -byte_tokens / byte_rate);
+		}
+		if(op_rate && op_tokens < 0) {
+			wait = std::max(wait, -op_tokens / op_rate);
+		}
+		return wait * 1e9;
+	}
+
+private:
+	std::mutex mutex;
+
+	double byte_rate = 0;		// 0 = unlimited
+	double op_rate = 0;			// 0 = unlimited
+	double byte_burst = 0;
+	double op_burst = 0;
+	double byte_tokens = 0;		// negative = debt
+	double op_tokens = 0;
+	int64_t last_time = 0;
+
+};
+
+
+} // mad
+
+#endif /* INCLUDE_RATELIMITER_H_ */
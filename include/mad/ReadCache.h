@@ -0,0 +1,265 @@
+/*
+ * ReadCache.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: mad
+ */
+
+#ifndef INCLUDE_READCACHE_H_
+#define INCLUDE_READCACHE_H_
+
+#include <deque>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+
+#include <cstdint>
+#include <cstddef>
+
+
+namespace mad {
+
+/*
+ * Bounded cache of clean pages, keyed by page index, using S3-FIFO replacement:
+ * new pages enter a small FIFO (10 %), pages hit again while in there are promoted to the main FIFO,
+ * others are evicted early and remembered in a ghost FIFO, so that one-time scans don't flush hot pages.
+ * Pages are owned by the caller: insert() and erase() hand back pages that are no longer referenced.
+ * Note: NOT thread-safe
+ */
+class ReadCache {
+public:
+	uint64_t num_hit = 0;
+	uint64_t num_miss = 0;
+
+	ReadCache(const size_t capacity)
+		:	capacity(std::max<size_t>(capacity, 2)),
+			small_capacity(std::max<size_t>(capacity / 10, 1))
+	{
+	}
+
+	/*
+	 * Returns cached page or nullptr.
+	 * @param touch If to count as re-use for replacement (false for sequential access)
+	 */
+	const uint8_t* find(const uint64_t index, const bool touch = true)
+	{
+		auto iter = table.find(index);
+		if(iter == table.end()) {
+			num_miss++;
+			return nullptr;
+		}
+		auto& entry = iter->second;
+		if(touch) {
+			entry.freq = std::min(entry.freq + 1, 3);
+		}
+		num_hit++;
+		return entry.page;
+	}
+
+	bool contains(const uint64_t index) const {
+		return table.count(index) > 0;
+	}
+
+	/*
+	 * Insert page, evicted pages are appended to `out`.
+	 * If `index` is already cached, `page` is appended to `out` instead.
+	 * @param hot If to insert into main queue directly (known to be needed soon)
+	 */
+	void insert(const uint64_t index, uint8_t* page, std::vector<uint8_t*>& out, const bool hot = false)
+	{
+		if(table.count(index)) {
+			out.push_back(page);
+			return;
+		}
+		while(table.size() >= capacity) {
+			evict(out);
+		}
+		entry_t entry;
+		entry.page = page;
+		entry.id = next_id++;
+
+		auto ghost_iter = ghost_table.find(index);
+		if(hot || ghost_iter != ghost_table.end()) {
+			// was evicted from small queue too early
+			if(ghost_iter != ghost_table.end()) {
+				ghost_table.erase(ghost_iter);
+			}
+			entry.main = true;
+			main.emplace_back(index, entry.id);
+			main_size++;
+		} else {
+			small.emplace_back(index, entry.id);
+			small_size++;
+		}
+		table[index] = entry;
+	}
+
+	/*
+	 * Remove page, returns page or nullptr if not cached.
+	 */
+	uint8_t* erase(const uint64_t index)
+	{
+		auto iter = table.find(index);
+		if(iter == table.end()) {
+			return nullptr;
+		}
+		const auto page = iter->second.page;
+		if(iter->second.main) {
+			main_size--;
+		} else {
+			small_size--;
+		}
+		table.erase(iter);		// queue entries are dropped lazily
+
+		if(small.size() + main.size() > table.size() + capacity) {
+			// too many stale entries, in case of frequent erase() without eviction
+			compact(small);
+			compact(main);
+		}
+		return page;
+	}
+
+	/*
+	 * Remove all pages, appending them to `out`.
+	 */
+	void clear(std::vector<uint8_t*>& out)
+	{
+		for(const auto& entry : table) {
+			out.push_back(entry.second.page);
+		}
+		table.clear();
+		ghost_table.clear();
+		small.clear();
+		main.clear();
+		ghost.clear();
+		small_size = 0;
+		main_size = 0;
+	}
+
+	size_t size() const {
+		return table.size();
+	}
+
+	size_t get_capacity() const {
+		return capacity;
+	}
+
+	size_t get_small_capacity() const {
+		return small_capacity;
+	}
+
+private:
+	struct entry_t {
+		uint8_t* page = nullptr;
+		uint64_t id = 0;
+		int freq = 0;
+		bool main = false;
+	};
+
+	typedef std::pair<uint64_t, uint64_t> key_t;		// [index, id]
+
+	// returns entry if queue element is still valid
+	entry_t* get_valid(const key_t& key)
+	{
+		auto iter = table.find(key.first);
+		if(iter != table.end() && iter->second.id == key.second) {
+			return &iter->second;
+		}
+		return nullptr;
+	}
+
+	void evict(std::vector<uint8_t*>& out)
+	{
+		if(small_size >= small_capacity || main_size == 0) {
+			while(!small.empty()) {
+				const auto key = small.front();
+				small.pop_front();
+				auto entry = get_valid(key);
+				if(!entry) {
+					continue;
+				}
+				small_size--;
+				if(entry->freq > 0) {
+					// promote to main
+					entry->freq = 0;
+					entry->main = true;
+					main.push_back(key);
+					main_size++;
+					if(main_size > capacity - small_capacity) {
+						break;
+					}
+					continue;
+				}
+				out.push_back(entry->page);
+				table.erase(key.first);
+				add_ghost(key.first);
+				return;
+			}
+		}
+		while(!main.empty()) {
+			const auto key = main.front();
+			main.pop_front();
+			auto entry = get_valid(key);
+			if(!entry) {
+				continue;
+			}
+			if(entry->freq > 0) {
+				entry->freq--;
+				main.push_back(key);
+				continue;
+			}
+			main_size--;
+			out.push_back(entry->page);
+			table.erase(key.first);
+			return;
+		}
+	}
+
+	// remove stale elements from queue, keeping order
+	void compact(std::deque<key_t>& queue)
+	{
+		std::deque<key_t> valid;
+		for(const auto& key : queue) {
+			if(get_valid(key)) {
+				valid.push_back(key);
+			}
+		}
+		queue.swap(valid);
+	}
+
+	void add_ghost(const uint64_t index)
+	{
+		ghost.push_back(index);
+		ghost_table[index]++;
+
+		while(ghost.size() > capacity) {
+			const auto old = ghost.front();
+			ghost.pop_front();
+			auto iter = ghost_table.find(old);
+			if(iter != ghost_table.end() && --iter->second == 0) {
+				ghost_table.erase(iter);
+			}
+		}
+	}
+
+private:
+	const size_t capacity;
+	const size_t small_capacity;
+
+	uint64_t next_id = 1;
+	size_t small_size = 0;
+	size_t main_size = 0;
+
+	std::deque<key_t> small;
+	std::deque<key_t> main;
+	std::deque<uint64_t> ghost;
+
+	std::unordered_map<uint64_t, entry_t> table;
+	std::unordered_map<uint64_t, uint32_t> ghost_table;
+
+};
+
+
+} // mad
+
+#endif /* INCLUDE_READCACHE_H_ */
@@ -0,0 +1,155 @@
+/*
+ * ThreadPool.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: mad
+ */
+
+#ifndef INCLUDE_THREADPOOL_H_
+#define INCLUDE_THREADPOOL_H_
+
+#include <mutex>
+#include <queue>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <exception>
+#include <functional>
+#include <condition_variable>
+
+
+namespace mad {
+
+/*
+ * Fixed size pool of worker threads executing tasks in FIFO order.
+ * Pending tasks are finished before destruction.
+ */
+class ThreadPool {
+public:
+	ThreadPool(const int num_threads)
+	{
+		for(int i = 0; i < std::max(num_threads, 1); ++i) {
+			threads.emplace_back(&ThreadPool::run, this);
+		}
+	}
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			do_run = false;
+		}
+		signal.notify_all();
+		for(auto& thread : threads) {
+			thread.join();
+		}
+	}
+
+	/*
+	 * Note: `task` must not throw
+	 * Note: thread-safe
+	 */
+	void add_task(const std::function<void()>& task)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			queue.push(task);
+		}
+		signal.notify_one();
+	}
+
+	/*
+	 * Calls `func(i)` for i in [0, count) with up to `max_threads` in parallel, including the calling thread.
+	 * Returns when all calls are done, re-throws the first exception.
+	 * Safe to call from a pool thread, the caller processes all items itself if no worker is free.
+	 * Note: thread-safe
+	 */
+	void run_parallel(const size_t count, const std::function<void(size_t)>& func, const int max_threads)
+	{
+		struct state_t {
+			std::mutex mutex;
+			std::condition_variable signal;
+			std::atomic<size_t> next {0};
+			size_t num_done = 0;
+			std::exception_ptr error;
+		};
+		const auto state = std::make_shared<state_t>();
+
+		const auto worker = [state, count, func]() {
+			while(true) {
+				const auto i = state->next++;
+				if(i >= count) {
+					break;
+				}
+				std::exception_ptr error;
+				try {
+					func(i);
+				} catch(...) {
+					error = std::current_exception();
+				}
+				std::lock_guard<std::mutex> lock(state->mutex);
+				if(error && !state->error) {
+					state->error = error;
+				}
+				if(++state->num_done == count) {
+					state->signal.notify_all();
+				}
+			}
+		};
+		const auto num_helpers = std::min<size_t>(std::min<size_t>(max_threads, threads.size() + 1), count);
+		for(size_t i = 1; i < num_helpers; ++i) {
+			add_task(worker);
+		}
+		worker();
+
+		std::unique_lock<std::mutex> lock(state->mutex);
+		while(state->num_done < count) {
+			state->signal.wait(lock);
+		}
+		if(state->error) {
+			std::rethrow_exception(state->error);
+		}
+	}
+
+	size_t get_num_threads() const {
+		return threads.size();
+	}
+
+private:
+	void run()
+	{
+		while(true) {
+			std::function<void()> task;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				while(do_run && queue.empty()) {
+					signal.wait(lock);
+				}
+				if(queue.empty()) {
+					break;
+				}
+				task = std::move(queue.front());
+				queue.pop();
+			}
+			task();
+		}
+	}
+
+private:
+	bool do_run = true;
+	std::mutex mutex;
+	std::condition_variable signal;
+	std::queue<std::function<void()>> queue;
+	std::vector<std::thread> threads;
+
+};
+
+
+} // mad
+
+#endif /* INCLUDE_THREADPOOL_H_ */
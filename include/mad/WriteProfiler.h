@@ -0,0 +1,197 @@
+/*
+ * WriteProfiler.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: mad
+ */
+
+#ifndef INCLUDE_WRITEPROFILER_H_
+#define INCLUDE_WRITEPROFILER_H_
+
+#include <map>
+#include <mutex>
+#include <algorithm>
+
+#include <cstdio>
+#include <cstdint>
+
+
+namespace mad {
+
+/*
+ * Collects the size and alignment distribution of writes,
+ * to show how much data takes the slow path through the page cache.
+ */
+class WriteProfiler {
+public:
+	static constexpr int num_buckets = 48;
+
+	// where to print the summary on DirectFile::close()
+	FILE* output = stderr;
+
+	// limit of pages tracked for multiple touches, when exceeded the current counts are folded into the totals
+	// Note: pages touched again after that (or after print_summary()) are counted as new pages
+	size_t max_tracked_pages = 1024 * 1024;
+
+	/*
+	 * Note: thread-safe
+	 */
+	void add(const uint64_t offset, const uint64_t length, const int log_page_size)
+	{
+		const uint64_t page_size = uint64_t(1) << log_page_size;
+		const uint64_t align_mask = page_size - 1;
+		const uint64_t offset_mod = offset & align_mask;
+
+		const uint64_t head = offset_mod ? std::min(page_size - offset_mod, length) : 0;
+		const uint64_t aligned = (length - head) & ~align_mask;
+		const uint64_t tail = length - head - aligned;
+
+		std::lock_guard<std::mutex> lock(mutex);
+
+		this->log_page_size = log_page_size;
+		num_writes++;
+		total_bytes += length;
+		head_bytes += head;
+		tail_bytes += tail;
+		aligned_bytes += aligned;
+
+		length_hist[get_log2(length)]++;
+		align_hist[std::min(get_trailing_zeros(offset), log_page_size)]++;
+
+		if(head) {
+			page_touch[offset >> log_page_size]++;
+		}
+		if(tail) {
+			page_touch[(offset + length - 1) >> log_page_size]++;
+		}
+		if(page_touch.size() > max_tracked_pages) {
+			fold_page_touch();
+		}
+	}
+
+	/*
+	 * Print histograms and recommendations.
+	 * Note: thread-safe
+	 */
+	void print_summary()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if(!output) {
+			return;
+		}
+		FILE* out = output;
+		const double total = std::max<uint64_t>(total_bytes, 1);
+		const double writes = std::max<uint64_t>(num_writes, 1);
+		const double cached = head_bytes + tail_bytes;
+
+		::fprintf(out, "[WriteProfiler] %llu writes, %.3f MiB total\n", (unsigned long long)num_writes, total_bytes / 1048576.);
+		::fprintf(out, "[WriteProfiler] aligned path: %.3f MiB (%.1f %%), page cache: %.3f MiB (%.1f %%, head %.3f MiB, tail %.3f MiB)\n",
+				aligned_bytes / 1048576., 100 * aligned_bytes / total, cached / 1048576., 100 * cached / total,
+				head_bytes / 1048576., tail_bytes / 1048576.);
+
+		::fprintf(out, "[WriteProfiler] write length:\n");
+		for(int i = 0; i < num_buckets; ++i) {
+			if(length_hist[i]) {
+				::fprintf(out, "    < %-14llu %10llu  (%.1f %%)\n",
+						(unsigned long long)(uint64_t(1) << i), (unsigned long long)length_hist[i], 100 * length_hist[i] / writes);
+			}
+		}
+		::fprintf(out, "[WriteProfiler] offset alignment:\n");
+		for(int i = 0; i <= log_page_size; ++i) {
+			if(align_hist[i]) {
+				::fprintf(out, "    %s%-12llu %10llu  (%.1f %%)\n", i < log_page_size ? "  " : ">=",
+						(unsigned long long)(uint64_t(1) << i), (unsigned long long)align_hist[i], 100 * align_hist[i] / writes);
+			}
+		}
+
+		fold_page_touch();
+
+		::fprintf(out, "[WriteProfiler] cached pages: %llu, touched more than once: %llu, average touches %.2f, max %llu\n",
+				(unsigned long long)num_touched, (unsigned long long)multi_touch,
+				sum_touch / double(std::max<uint64_t>(num_touched, 1)), (unsigned long long)max_touch);
+
+		// recommendations
+		const auto page_size = uint64_t(1) << log_page_size;
+		if(cached > 0.2 * total) {
+			::fprintf(out, "[WriteProfiler] %.0f %% of bytes went through page cache: align offset and length to %llu bytes\n",
+					100 * cached / total, (unsigned long long)page_size);
+		}
+		if(align_hist[log_page_size] < 0.5 * writes) {
+			::fprintf(out, "[WriteProfiler] %.0f %% of writes start at an unaligned offset: reserve file ranges in multiples of %llu bytes\n",
+					100 * (1 - align_hist[log_page_size] / writes), (unsigned long long)page_size);
+		}
+		uint64_t num_small = 0;
+		for(int i = 0; i <= log_page_size; ++i) {
+			num_small += length_hist[i];
+		}
+		if(num_small > 0.5 * writes) {
+			::fprintf(out, "[WriteProfiler] %.0f %% of writes are smaller than a page: batch them into larger writes\n",
+					100 * num_small / writes);
+		}
+		if(multi_touch > 0.1 * num_touched) {
+			::fprintf(out, "[WriteProfiler] %.0f %% of cached pages are written by multiple calls: "
+					"each costs a lock and possibly a read-modify-write\n",
+					100 * multi_touch / double(num_touched));
+		}
+	}
+
+private:
+	// move counts of `page_touch` into the totals, requires lock
+	void fold_page_touch()
+	{
+		for(const auto& entry : page_touch) {
+			max_touch = std::max<uint64_t>(max_touch, entry.second);
+			sum_touch += entry.second;
+			multi_touch += entry.second > 1;
+		}
+		num_touched += page_touch.size();
+		page_touch.clear();
+	}
+
+	static int get_log2(uint64_t value) {
+		int out = 0;
+		while(value && out < num_buckets - 1) {
+			value >>= 1;
+			out++;
+		}
+		return out;
+	}
+
+	static int get_trailing_zeros(uint64_t value) {
+		if(!value) {
+			return 64;
+		}
+		int out = 0;
+		while(!(value & 1)) {
+			value >>= 1;
+			out++;
+		}
+		return out;
+	}
+
+private:
+	std::mutex mutex;
+
+	int log_page_size = 12;
+	uint64_t num_writes = 0;
+	uint64_t total_bytes = 0;
+	uint64_t head_bytes = 0;
+	uint64_t tail_bytes = 0;
+	uint64_t aligned_bytes = 0;
+
+	uint64_t length_hist[num_buckets] = {};
+	uint64_t align_hist[65] = {};
+
+	std::map<uint64_t, uint32_t> page_touch;		// see max_tracked_pages
+	uint64_t num_touched = 0;		// pages folded from `page_touch`
+	uint64_t sum_touch = 0;
+	uint64_t multi_touch = 0;
+	uint64_t max_touch = 0;
+
+};
+
+
+} // mad
+
+#endif /* INCLUDE_WRITEPROFILER_H_ */
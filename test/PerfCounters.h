@@ -0,0 +1,199 @@
+/*
+ * PerfCounters.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: mad
+ */
+
+#ifndef TEST_PERFCOUNTERS_H_
+#define TEST_PERFCOUNTERS_H_
+
+#include <string>
+#include <vector>
+#include <ostream>
+
+#include <cstdint>
+#include <cstring>
+
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+
+/*
+ * Hardware / software counters via perf_event_open(), for the calling process.
+ * Threads created after construction are included (inherit).
+ * Falls back to user space only counting when kernel profiling is not permitted,
+ * counters that cannot be opened at all report zero and is_valid() returns false.
+ */
+class PerfCounters {
+public:
+	struct values_t {
+		uint64_t cycles = 0;
+		uint64_t instructions = 0;
+		uint64_t cache_misses = 0;
+		uint64_t context_switches = 0;
+		uint64_t page_faults = 0;
+	};
+
+	PerfCounters()
+	{
+		fds[0] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+		fds[1] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+		fds[2] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+		fds[3] = open_counter(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES);
+		fds[4] = open_counter(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS);
+	}
+
+	PerfCounters(const PerfCounters&) = delete;
+	PerfCounters& operator=(const PerfCounters&) = delete;
+
+	~PerfCounters() {
+		for(auto fd : fds) {
+			if(fd >= 0) {
+				::close(fd);
+			}
+		}
+	}
+
+	void start()
+	{
+		for(auto fd : fds) {
+			if(fd >= 0) {
+				::ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+				::ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+			}
+		}
+	}
+
+	void stop()
+	{
+		for(auto fd : fds) {
+			if(fd >= 0) {
+				::ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+			}
+		}
+	}
+
+	values_t read() const
+	{
+		values_t out;
+		out.cycles = read_counter(fds[0]);
+		out.instructions = read_counter(fds[1]);
+		out.cache_misses = read_counter(fds[2]);
+		out.context_switches = read_counter(fds[3]);
+		out.page_faults = read_counter(fds[4]);
+		return out;
+	}
+
+	// true if all counters are available
+	bool is_valid() const
+	{
+		for(auto fd : fds) {
+			if(fd < 0) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// true if kernel time is excluded (not permitted)
+	bool is_user_only() const {
+		return user_only;
+	}
+
+	/*
+	 * Print counters normalized per GiB written.
+	 */
+	void print(std::ostream& out, const uint64_t bytes) const
+	{
+		const auto values = read();
+		const double GiB = bytes / double(uint64_t(1) << 30);
+
+		out << "Perf counters per GiB" << (user_only ? " (user space only)" : "") << ":";
+		print_value(out, " cycles", values.cycles, fds[0], GiB);
+		print_value(out, ", instructions", values.instructions, fds[1], GiB);
+		print_value(out, ", cache-misses", values.cache_misses, fds[2], GiB);
+		print_value(out, ", context-switches", values.context_switches, fds[3], GiB);
+		print_value(out, ", page-faults", values.page_faults, fds[4], GiB);
+		if(values.cycles && fds[1] >= 0) {
+			out << ", IPC " << values.instructions / double(values.cycles);
+		}
+		out << std::endl;
+	}
+
+	// CSV header for csv_row()
+	static std::string csv_header() {
+		return "cycles_per_GiB,instructions_per_GiB,cache_misses_per_GiB,context_switches_per_GiB,page_faults_per_GiB";
+	}
+
+	std::string csv_row(const uint64_t bytes) const
+	{
+		const auto values = read();
+		const double GiB = bytes / double(uint64_t(1) << 30);
+		const uint64_t list[] = {values.cycles, values.instructions, values.cache_misses, values.context_switches, values.page_faults};
+
+		std::string out;
+		for(int i = 0; i < 5; ++i) {
+			if(i) {
+				out += ",";
+			}
+			if(fds[i] >= 0) {
+				out += std::to_string(uint64_t(list[i] / GiB));	// empty if not available
+			}
+		}
+		return out;
+	}
+
+private:
+	int open_counter(const uint32_t type, const uint64_t config)
+	{
+		perf_event_attr attr;
+		::memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = type;
+		attr.config = config;
+		attr.disabled = 1;
+		attr.inherit = 1;
+		attr.exclude_hv = 1;
+		attr.exclude_kernel = user_only;
+
+		int fd = ::syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+		if(fd < 0 && !user_only) {
+			attr.exclude_kernel = 1;
+			fd = ::syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+			if(fd >= 0) {
+				user_only = true;
+			}
+		}
+		return fd;
+	}
+
+	static uint64_t read_counter(const int fd)
+	{
+		uint64_t value = 0;
+		if(fd < 0 || ::read(fd, &value, sizeof(value)) != sizeof(value)) {
+			return 0;
+		}
+		return value;
+	}
+
+	static void print_value(std::ostream& out, const char* name, const uint64_t value, const int fd, const double GiB)
+	{
+		out << name << " ";
+		if(fd < 0) {
+			out << "n/a";
+		} else {
+			out << uint64_t(value / GiB);
+		}
+	}
+
+private:
+	int fds[5];
+	bool user_only = false;
+
+};
+
+
+#endif /* TEST_PERFCOUNTERS_H_ */
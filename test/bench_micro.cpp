@@ -0,0 +1,215 @@
+/*
+ * bench_micro.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: mad
+ */
+
+#include <mad/DirectFile.h>
+
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <vector>
+#include <chrono>
+#include <thread>
+
+inline
+int64_t get_time_nanos() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/*
+ * DirectFile on top of a mock device that completes all I/O instantly.
+ * Reads see an empty file.
+ */
+class MockFile : public mad::DirectFile {
+public:
+	MockFile(bool read_flag = false)
+		:	DirectFile("/dev/null", read_flag, true)
+	{
+		write_behind_bytes = 0;		// O_DIRECT fails on /dev/null, avoid buffered mode syscalls
+	}
+
+	~MockFile() {
+		close();
+	}
+
+	using DirectFile::acquire_lock;
+	using DirectFile::get_page;
+	using DirectFile::flush_no_lock;
+
+protected:
+	ssize_t do_pwrite(const void*, const size_t count, const uint64_t) override {
+		return count;
+	}
+
+	ssize_t do_pread(void*, const size_t, const uint64_t) override {
+		return 0;
+	}
+};
+
+static
+void report(const std::string& name, const int64_t time_ns, const uint64_t num_ops, const uint64_t bytes = 0)
+{
+	std::cout << std::left << std::setw(44) << name << std::right << std::setw(12) << std::fixed << std::setprecision(1)
+			<< time_ns / double(num_ops) << " ns/op";
+	if(bytes) {
+		std::cout << std::setw(12) << std::setprecision(2) << bytes / (time_ns / 1e9) / pow(1024, 3) << " GiB/s";
+	}
+	std::cout << std::endl;
+}
+
+static
+void bench_get_page(const uint64_t num_pages, const uint64_t num_iter)
+{
+	MockFile file;
+	std::default_random_engine generator;
+
+	const auto time_alloc = get_time_nanos();
+	for(uint64_t i = 0; i < num_pages; ++i) {
+		file.get_page(i * 4096);
+	}
+	report("get_page() miss, " + std::to_string(num_pages) + " pages", get_time_nanos() - time_alloc, num_pages);
+
+	std::vector<uint64_t> addr(num_iter);
+	for(auto& v : addr) {
+		v = (generator() % num_pages) * 4096;
+	}
+	uint64_t sum = 0;
+	const auto time_begin = get_time_nanos();
+	for(const auto a : addr) {
+		sum += *file.get_page(a);
+	}
+	report("get_page() hit, " + std::to_string(num_pages) + " pages", get_time_nanos() - time_begin, num_iter);
+
+	file.flush_no_lock();
+	if(sum) {
+		std::cout << std::endl;	// prevent optimizing out
+	}
+}
+
+static
+void bench_invalidate(const uint64_t num_pages, const uint64_t num_iter)
+{
+	MockFile file;
+	file.auto_flush_bytes = 0;
+
+	std::vector<uint8_t> data(num_pages * 4096);
+	mad::DirectFile::buffer_t buffer;
+
+	int64_t total = 0;
+	for(uint64_t k = 0; k < num_iter; ++k) {
+		{
+			const auto lock = file.acquire_lock();
+			for(uint64_t i = 0; i < num_pages; ++i) {
+				file.get_page(i * 4096);
+			}
+		}
+		const auto time_begin = get_time_nanos();
+		file.write(data.data(), data.size(), 0, buffer);	// aligned, over-writes all cached pages
+		total += get_time_nanos() - time_begin;
+	}
+	report("write() invalidating " + std::to_string(num_pages) + " cached pages", total, num_iter, num_iter * data.size());
+}
+
+static
+void bench_flush(const uint64_t num_pages, const uint64_t num_iter)
+{
+	MockFile file;
+
+	int64_t total = 0;
+	for(uint64_t k = 0; k < num_iter; ++k) {
+		const auto lock = file.acquire_lock();
+		for(uint64_t i = 0; i < num_pages; ++i) {
+			file.get_page(i * 4096 * 3);
+		}
+		const auto time_begin = get_time_nanos();
+		file.flush_no_lock();
+		total += get_time_nanos() - time_begin;
+	}
+	report("flush_no_lock() per page, " + std::to_string(num_pages) + " pages", total, num_iter * num_pages);
+}
+
+static
+void bench_unaligned_write(const uint64_t length, const uint64_t num_iter)
+{
+	MockFile file;
+	std::vector<uint8_t> data(length);
+	mad::DirectFile::buffer_t buffer;
+
+	const auto time_begin = get_time_nanos();
+	for(uint64_t i = 0; i < num_iter; ++i) {
+		file.write(data.data(), length, i * length, buffer);
+	}
+	report("write() sequential " + std::to_string(length) + " bytes", get_time_nanos() - time_begin, num_iter, num_iter * length);
+}
+
+static
+void bench_memcpy(const size_t length, const uint64_t num_iter)
+{
+	std::vector<uint8_t> src(length + 1);
+	auto dst = (uint8_t*)::aligned_alloc(4096, length);
+
+	for(int offset = 0; offset < 2; ++offset) {
+		const auto time_begin = get_time_nanos();
+		for(uint64_t i = 0; i < num_iter; ++i) {
+			::memcpy(dst, src.data() + offset, length);
+			src[i % length] = dst[(i * 7) % length];
+		}
+		report("memcpy() " + std::to_string(length) + " bytes, " + (offset ? "unaligned" : "aligned") + " source",
+				get_time_nanos() - time_begin, num_iter, num_iter * length);
+	}
+	::free(dst);
+}
+
+static
+void bench_lock(const int num_threads, const uint64_t num_iter)
+{
+	MockFile file;
+
+	std::vector<std::thread> threads;
+	const auto time_begin = get_time_nanos();
+	for(int i = 0; i < num_threads; ++i) {
+		threads.emplace_back([&file, num_iter]() {
+			for(uint64_t k = 0; k < num_iter; ++k) {
+				const auto lock = file.acquire_lock();
+			}
+		});
+	}
+	for(auto& thread : threads) {
+		thread.join();
+	}
+	const auto stats = file.get_stats();
+	report("acquire_lock() with " + std::to_string(num_threads) + " threads", get_time_nanos() - time_begin, num_iter * num_threads);
+	std::cout << "    contended " << 100. * stats.num_lock_wait / (num_iter * num_threads) << " %" << std::endl;
+}
+
+
+int main(int argc, char** argv)
+{
+	const uint64_t scale = (argc > 1 ? std::max(atoi(argv[1]), 1) : 1);
+
+	for(const auto num_pages : {16, 1024, 65536}) {
+		bench_get_page(num_pages, scale * 1000000);
+	}
+	for(const auto num_pages : {1, 16, 256}) {
+		bench_invalidate(num_pages, scale * 10000);
+	}
+	for(const auto num_pages : {16, 1024}) {
+		bench_flush(num_pages, scale * 1000);
+	}
+	for(const auto length : {100, 5000, 1048577}) {
+		bench_unaligned_write(length, scale * 100000000 / length + 100);
+	}
+	for(const auto length : {4096, 65536, 1048576}) {
+		bench_memcpy(length, scale * 1000000000 / length);
+	}
+	for(const auto num_threads : {1, 2, 4, 8}) {
+		bench_lock(num_threads, scale * 1000000 / num_threads);
+	}
+	return 0;
+}
+
@@ -0,0 +1,251 @@
+/*
+ * bench_sweep.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: mad
+ */
+
+#include <mad/DirectFile.h>
+
+#include "PerfCounters.h"
+
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <vector>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+#include <getopt.h>
+
+inline
+int64_t get_time_micros() {
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+template<typename T>
+std::vector<T> parse_list(const std::string& str)
+{
+	std::vector<T> list;
+	std::istringstream in(str);
+	std::string item;
+	while(std::getline(in, item, ',')) {
+		std::istringstream tmp(item);
+		T value;
+		if(tmp >> value) {
+			list.push_back(value);
+		}
+	}
+	return list;
+}
+
+struct config_t {
+	int num_threads = 8;
+	size_t buffer_size = 1024 * 1024;
+	int log_page_size = 12;
+	size_t auto_flush_bytes = 4 * 1024 * 1024;
+	std::string dist = "random";
+	bool auto_tune = false;
+};
+
+struct result_t {
+	double MBps = 0;
+	double elapsed = 0;
+	mad::DirectFile::stats_t stats;
+	std::string perf;
+};
+
+/*
+ * Write size distributions:
+ *   random   uniform in [0, 16 MiB), like test_write
+ *   small    uniform in [0, 64 KiB)
+ *   fixed    always 1 MiB + 1 byte, i.e. every write is unaligned
+ *   aligned  random multiple of page size up to 4 MiB
+ */
+static
+uint64_t next_write_size(const std::string& dist, std::default_random_engine& generator, const size_t page_size)
+{
+	if(dist == "small") {
+		return generator() % (64 * 1024);
+	}
+	if(dist == "fixed") {
+		return 1024 * 1024 + 1;
+	}
+	if(dist == "aligned") {
+		return (1 + generator() % (4 * 1024 * 1024 / page_size)) * page_size;
+	}
+	if(dist == "random") {
+		return generator() % (16 * 1024 * 1024);
+	}
+	throw std::logic_error("unknown distribution: " + dist);
+}
+
+static
+result_t run(const std::string& path, const uint64_t file_size, const config_t& config, const std::vector<uint8_t>& data)
+{
+	::remove(path.c_str());
+
+	result_t out;
+	PerfCounters perf;
+	perf.start();
+
+	const auto time_begin = get_time_micros();
+	{
+		mad::DirectFile file(path, false, true, true, config.log_page_size, config.buffer_size);
+		file.auto_flush_bytes = config.auto_flush_bytes;
+		if(config.auto_tune) {
+			file.enable_auto_tune();
+		}
+
+		std::mutex mutex;
+		uint64_t offset = 0;
+		std::default_random_engine generator;
+		std::vector<std::thread> threads;
+
+		for(int i = 0; i < config.num_threads; ++i)
+		{
+			threads.emplace_back([&]()
+			{
+				mad::DirectFile::buffer_t buffer;
+
+				while(true) {
+					std::unique_lock<std::mutex> lock(mutex);
+
+					if(offset >= file_size) {
+						break;
+					}
+					const auto src = offset % data.size();
+
+					auto count = next_write_size(config.dist, generator, size_t(1) << config.log_page_size);
+					count = std::min(count, file_size - offset);
+					count = std::min(count, data.size() - src);
+
+					const auto offset_ = offset;
+					offset += count;
+
+					lock.unlock();
+
+					file.write(data.data() + src, count, offset_, buffer);
+				}
+			});
+		}
+		for(auto& thread : threads) {
+			thread.join();
+		}
+		file.close();
+
+		perf.stop();
+		out.stats = file.get_stats();
+		out.perf = perf.csv_row(file_size);
+	}
+	const auto time_end = get_time_micros();
+
+	out.elapsed = (time_end - time_begin) / 1e6;
+	out.MBps = file_size / out.elapsed / pow(1024, 2);
+	return out;
+}
+
+static
+void print_usage()
+{
+	std::cerr << "Usage: bench_sweep [options] <file>" << std::endl;
+	std::cerr << "  -s <MiB>          file size per run (default 1024)" << std::endl;
+	std::cerr << "  -r <count>        runs per point (default 3)" << std::endl;
+	std::cerr << "  -t <list>         thread counts (default 1,2,4,8,16)" << std::endl;
+	std::cerr << "  -b <list>         buffer_size in KiB (default 256,1024,4096)" << std::endl;
+	std::cerr << "  -p <list>         log_page_size (default 12)" << std::endl;
+	std::cerr << "  -f <list>         auto_flush_bytes in KiB (default 0,4096)" << std::endl;
+	std::cerr << "  -d <list>         write size distribution: random,small,fixed,aligned (default random)" << std::endl;
+	std::cerr << "  -a                enable DirectFile auto tuning (buffer_size and auto_flush_bytes are start values)" << std::endl;
+}
+
+
+int main(int argc, char** argv)
+{
+	uint64_t file_size = uint64_t(1024) * 1024 * 1024;
+	int num_runs = 3;
+	std::vector<int> list_threads {1, 2, 4, 8, 16};
+	std::vector<size_t> list_buffer {256, 1024, 4096};
+	std::vector<int> list_page {12};
+	std::vector<size_t> list_flush {0, 4096};
+	std::vector<std::string> list_dist {"random"};
+	bool auto_tune = false;
+
+	int c = 0;
+	while((c = ::getopt(argc, argv, "s:r:t:b:p:f:d:ah")) != -1)
+	{
+		switch(c) {
+			case 's': file_size = uint64_t(atoll(optarg)) * 1024 * 1024; break;
+			case 'r': num_runs = std::max(atoi(optarg), 1); break;
+			case 't': list_threads = parse_list<int>(optarg); break;
+			case 'b': list_buffer = parse_list<size_t>(optarg); break;
+			case 'p': list_page = parse_list<int>(optarg); break;
+			case 'f': list_flush = parse_list<size_t>(optarg); break;
+			case 'd': list_dist = parse_list<std::string>(optarg); break;
+			case 'a': auto_tune = true; break;
+			default:
+				print_usage();
+				return -1;
+		}
+	}
+	if(argc - optind != 1) {
+		print_usage();
+		return -1;
+	}
+	const std::string path(argv[optind]);
+
+	std::default_random_engine generator;
+
+	std::vector<uint8_t> data(uint64_t(16) << 20);
+	for(auto& v : data) {
+		v = generator();
+	}
+
+	std::cout << "threads,buffer_size,log_page_size,auto_flush_bytes,dist,runs,"
+			"MiB_s_median,MiB_s_min,MiB_s_max,syscalls,pwrite,pwrite_flush,pread,flushes,"
+			"bytes_direct,bytes_cached,lock_waits,lock_wait_ms,final_chunk_size,final_auto_flush_bytes,io_mode,write_behind,"
+			<< PerfCounters::csv_header() << std::endl;
+
+	for(const auto& dist : list_dist)
+	for(const auto log_page_size : list_page)
+	for(const auto buffer_KiB : list_buffer)
+	for(const auto flush_KiB : list_flush)
+	for(const auto num_threads : list_threads)
+	{
+		config_t config;
+		config.num_threads = num_threads;
+		config.buffer_size = buffer_KiB * 1024;
+		config.log_page_size = log_page_size;
+		config.auto_flush_bytes = flush_KiB * 1024;
+		config.dist = dist;
+		config.auto_tune = auto_tune;
+
+		std::vector<result_t> results;
+		for(int i = 0; i < num_runs; ++i) {
+			results.push_back(run(path, file_size, config, data));
+		}
+		std::sort(results.begin(), results.end(),
+			[](const result_t& L, const result_t& R) -> bool {
+				return L.MBps < R.MBps;
+			});
+		const auto& median = results[results.size() / 2];
+		const auto& stats = median.stats;
+
+		std::cout << num_threads << "," << config.buffer_size << "," << log_page_size << "," << config.auto_flush_bytes << ","
+				<< dist << "," << num_runs << ","
+				<< median.MBps << "," << results.front().MBps << "," << results.back().MBps << ","
+				<< stats.num_syscalls() << "," << stats.num_pwrite << "," << stats.num_pwrite_flush << "," << stats.num_pread << ","
+				<< stats.num_flush << "," << stats.bytes_direct << "," << stats.bytes_cached << ","
+				<< stats.num_lock_wait << "," << stats.lock_wait_ns / 1e6 << ","
+				<< stats.chunk_size << "," << stats.auto_flush_bytes << ","
+				<< (stats.io_mode == mad::DirectFile::IO_MODE_DIRECT ? "direct" : "buffered") << "," << stats.num_write_behind << ","
+				<< median.perf << std::endl;
+	}
+	::remove(path.c_str());
+
+	return 0;
+}
+
@@ -0,0 +1,249 @@
+/*
+ * test_async.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: mad
+ */
+
+#include <mad/DirectFile.h>
+
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <vector>
+#include <chrono>
+
+#include <sys/epoll.h>
+#include <poll.h>
+
+inline
+int64_t get_time_micros() {
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static
+size_t verify(const std::string& path, const std::vector<uint8_t>& data, const size_t num_slots, const size_t slot_size)
+{
+	mad::DirectFile file(path, true, false);
+	mad::DirectFile::buffer_t buffer;
+	std::vector<uint8_t> tmp(slot_size);
+	for(size_t i = 0; i < num_slots; ++i) {
+		const auto length = 1 + (i * 7919) % slot_size;
+		file.read(tmp.data(), length, i * slot_size, buffer);
+		if(::memcmp(tmp.data(), data.data() + i * slot_size, length)) {
+			std::cerr << "ERROR: wrong data on device in slot " << i << std::endl;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Drives DirectFile from a single threaded epoll loop via its completion eventfd:
+ * every slot is written, then read back once its write completed.
+ */
+int main(int argc, char** argv)
+{
+	if(argc < 2) {
+		return -1;
+	}
+	const std::string path(argv[1]);
+	const size_t num_slots = (argc > 2 ? atoi(argv[2]) : 10000);
+	const size_t slot_size = 20000;
+
+	::remove(path.c_str());
+
+	std::cout << "File: " << path << std::endl;
+	std::cout << "Slots: " << num_slots << std::endl;
+
+	std::mt19937_64 generator;
+	std::vector<uint8_t> data(num_slots * slot_size);
+	for(auto& v : data) {
+		v = generator();
+	}
+	std::vector<uint8_t> tmp(data.size());		// read back buffer
+
+	size_t num_failed = 0;
+	{
+		mad::DirectFile file(path, true, true, true);
+
+		const int epoll_fd = ::epoll_create1(EPOLL_CLOEXEC);
+		if(epoll_fd < 0) {
+			std::cerr << "epoll_create1() failed" << std::endl;
+			return -1;
+		}
+		epoll_event event = {};
+		event.events = EPOLLIN;
+		if(::epoll_ctl(epoll_fd, EPOLL_CTL_ADD, file.get_completion_fd(), &event) < 0) {
+			std::cerr << "epoll_ctl() failed" << std::endl;
+			return -1;
+		}
+		const auto time_begin = get_time_micros();
+
+		for(size_t i = 0; i < num_slots; ++i) {
+			const auto length = 1 + (i * 7919) % slot_size;
+			file.submit_write(data.data() + i * slot_size, length, i * slot_size, i);
+		}
+		size_t num_reads = 0;
+		size_t num_wakeups = 0;
+		bool flushed = false;
+
+		while(!flushed) {
+			epoll_event events[1];
+			if(::epoll_wait(epoll_fd, events, 1, 10000) <= 0) {
+				std::cerr << "ERROR: epoll_wait() timeout" << std::endl;
+				return 1;
+			}
+			num_wakeups++;
+			for(const auto& done : file.reap_completions()) {
+				if(!done.ok()) {
+					try {
+						std::rethrow_exception(done.error);
+					} catch(const std::exception& ex) {
+						std::cerr << "ERROR: " << ex.what() << std::endl;
+					}
+					num_failed++;
+					continue;
+				}
+				switch(done.op) {
+					case mad::DirectFile::ASYNC_WRITE:
+						file.submit_read(tmp.data() + done.offset, done.length, done.offset, done.user_data);
+						break;
+					case mad::DirectFile::ASYNC_READ:
+						if(::memcmp(tmp.data() + done.offset, data.data() + done.offset, done.length)) {
+							std::cerr << "ERROR: wrong data in slot " << done.user_data << std::endl;
+							num_failed++;
+						}
+						if(++num_reads == num_slots) {
+							file.submit_flush();
+						}
+						break;
+					case mad::DirectFile::ASYNC_FLUSH:
+						flushed = true;
+						break;
+				}
+			}
+		}
+		const auto elapsed = (get_time_micros() - time_begin) / 1e6;
+		std::cout << "Took " << elapsed << " sec, " << num_slots / elapsed << " slots/s, "
+				<< num_wakeups << " wakeups" << std::endl;
+
+		if(file.get_num_in_flight() || !file.reap_completions().empty()) {
+			std::cerr << "ERROR: operations left after flush" << std::endl;
+			num_failed++;
+		}
+		::close(epoll_fd);
+		file.close();
+	}
+	num_failed += verify(path, data, num_slots, slot_size);
+	::remove(path.c_str());
+
+	// try_write() from a "hot" thread, deferred writes are reaped afterwards
+	{
+		mad::DirectFile file(path, true, true, true);
+		mad::DirectFile::buffer_t buffer;
+		mad::IOTrace trace;
+		file.trace = &trace;
+
+		size_t num_deferred = 0;
+		int64_t max_time = 0;
+		const auto time_begin = get_time_micros();
+
+		for(size_t i = 0; i < num_slots; ++i) {
+			const auto length = 1 + (i * 7919) % slot_size;
+			const auto begin = get_time_micros();
+			if(!file.try_write(data.data() + i * slot_size, length, i * slot_size, buffer, i)) {
+				num_deferred++;
+			}
+			max_time = std::max(get_time_micros() - begin, max_time);
+		}
+		const auto elapsed = (get_time_micros() - time_begin) / 1e6;
+
+		size_t num_reaped = 0;
+		const int fd = file.get_completion_fd();
+		while(num_reaped < num_deferred) {
+			pollfd entry = {fd, POLLIN, 0};
+			if(::poll(&entry, 1, 10000) <= 0) {
+				std::cerr << "ERROR: poll() timeout" << std::endl;
+				return 1;
+			}
+			for(const auto& done : file.reap_completions()) {
+				if(!done.ok() || done.op != mad::DirectFile::ASYNC_WRITE) {
+					std::cerr << "ERROR: deferred write failed for slot " << done.user_data << std::endl;
+					num_failed++;
+				}
+				num_reaped++;
+			}
+		}
+		file.close();
+
+		// deferred writes must not be recorded again
+		size_t num_traced = 0;
+		for(const auto& record : trace.get_records()) {
+			num_traced += (record.op == mad::IOTrace::OP_WRITE);
+		}
+		if(num_traced != num_slots) {
+			std::cerr << "ERROR: traced " << num_traced << " writes instead of " << num_slots << std::endl;
+			num_failed++;
+		}
+
+		std::cout << "try_write() took " << elapsed << " sec, " << num_slots / elapsed << " writes/s, "
+				<< num_deferred << " deferred, " << file.get_stats().num_write_deferred
+				<< " deferred (stats), max " << max_time << " us" << std::endl;
+	}
+	num_failed += verify(path, data, num_slots, slot_size);
+
+	// page aligned try_write() over allocated data, RWF_NOWAIT should succeed (if supported)
+	{
+		mad::DirectFile::buffer_t buffer;
+		{
+			// slots leave holes, fill them such that no allocation is needed below
+			mad::DirectFile file(path, true, true);
+			file.write(data.data(), data.size(), 0, buffer);
+		}
+		mad::DirectFile file(path, true, true);
+
+		const size_t page_size = file.get_page_size();
+		const size_t num_pages = data.size() / page_size;
+		const size_t chunk = 16;
+
+		size_t num_done = 0;
+		size_t num_deferred = 0;
+		for(size_t i = 0; i + chunk <= num_pages; i += chunk) {
+			const auto offset = i * page_size;
+			if(file.try_write(data.data() + offset, chunk * page_size, offset, buffer, i)) {
+				num_done++;
+			} else {
+				num_deferred++;
+			}
+		}
+		file.close();
+		for(const auto& done : file.reap_completions()) {
+			if(!done.ok()) {
+				std::cerr << "ERROR: deferred write failed at offset " << done.offset << std::endl;
+				num_failed++;
+			}
+		}
+		std::cout << "Aligned try_write(): " << num_done << " done, " << num_deferred << " deferred" << std::endl;
+
+		if(file.is_direct() && !num_done) {
+			std::cerr << "ERROR: no aligned try_write() succeeded without blocking" << std::endl;
+			num_failed++;
+		}
+		// deferred writes must not be counted twice
+		if(file.get_stats().num_pwrite != num_done + num_deferred) {
+			std::cerr << "ERROR: counted " << file.get_stats().num_pwrite << " aligned writes instead of "
+					<< num_done + num_deferred << std::endl;
+			num_failed++;
+		}
+	}
+	num_failed += verify(path, data, num_slots, slot_size);
+	::remove(path.c_str());
+
+	if(num_failed) {
+		std::cout << "Verify FAILED" << std::endl;
+		return 1;
+	}
+	std::cout << "Verify passed" << std::endl;
+	return 0;
+}
@@ -0,0 +1,107 @@
+/*
+ * test_coroutine.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: mad
+ */
+
+#include <mad/AsyncFile.h>
+
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <vector>
+#include <chrono>
+
+inline
+int64_t get_time_micros() {
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+#ifdef MAD_HAVE_COROUTINES
+
+/*
+ * Writes one slot, reads it back and compares.
+ */
+static
+mad::Task<bool> write_read(mad::AsyncFile& file, const uint8_t* data, const size_t length, const uint64_t offset)
+{
+	co_await file.write(data, length, offset);
+
+	std::vector<uint8_t> tmp(length);
+	co_await file.read(tmp.data(), length, offset);
+
+	co_return ::memcmp(tmp.data(), data, length) == 0;
+}
+
+static
+mad::Task<void> client(mad::AsyncFile& file, const std::vector<uint8_t>& data, const size_t slot, const size_t slot_size, size_t& num_failed)
+{
+	const auto length = 1 + (slot * 7919) % slot_size;
+	const auto offset = slot * slot_size;
+	if(!co_await write_read(file, data.data() + offset, length, offset)) {
+		std::cerr << "ERROR: wrong data in slot " << slot << std::endl;
+		num_failed++;	// only modified on reactor thread
+	}
+}
+
+#endif
+
+
+int main(int argc, char** argv)
+{
+	if(argc < 2) {
+		return -1;
+	}
+#ifdef MAD_HAVE_COROUTINES
+	const std::string path(argv[1]);
+	const size_t num_slots = (argc > 2 ? atoi(argv[2]) : 10000);
+	const int num_threads = (argc > 3 ? atoi(argv[3]) : 8);
+	const size_t slot_size = 20000;
+
+	::remove(path.c_str());
+
+	std::cout << "File: " << path << std::endl;
+	std::cout << "Coroutines: " << num_slots << std::endl;
+	std::cout << "Threads: " << num_threads << std::endl;
+
+	std::mt19937_64 generator;
+	std::vector<uint8_t> data(num_slots * slot_size);
+	for(auto& v : data) {
+		v = generator();
+	}
+	size_t num_failed = 0;
+	{
+		mad::DirectFile file(path, true, true, true);
+		file.num_io_threads = num_threads;
+		mad::Reactor reactor;
+		mad::AsyncFile async(file, reactor);
+
+		const auto time_begin = get_time_micros();
+		for(size_t i = 0; i < num_slots; ++i) {
+			reactor.spawn(client(async, data, i, slot_size, num_failed));
+		}
+		reactor.run();
+
+		reactor.spawn([](mad::AsyncFile& async) -> mad::Task<void> {
+			co_await async.flush();
+		}(async));
+		reactor.run();
+
+		const auto elapsed = (get_time_micros() - time_begin) / 1e6;
+		std::cout << "Took " << elapsed << " sec, " << num_slots / elapsed << " coroutines/s" << std::endl;
+		file.close();
+	}
+	::remove(path.c_str());
+
+	if(num_failed) {
+		std::cout << "Verify FAILED" << std::endl;
+		return 1;
+	}
+	std::cout << "Verify passed" << std::endl;
+#else
+	std::cout << "Coroutines not supported by compiler" << std::endl;
+#endif
+	return 0;
+}
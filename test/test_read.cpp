@@ -0,0 +1,396 @@
+/*
+ * test_read.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: mad
+ */
+
+#include <mad/DirectFile.h>
+#include <mad/ParallelScan.h>
+
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <vector>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+inline
+int64_t get_time_micros() {
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+int main(int argc, char** argv)
+{
+	if(argc < 2) {
+		return -1;
+	}
+	const std::string path(argv[1]);
+
+	::remove(path.c_str());
+
+	const uint64_t file_size = uint64_t(argc > 2 ? atoi(argv[2]) : 256) * 1024 * 1024;
+	const int num_threads = (argc > 3 ? atoi(argv[3]) : 8);
+	const size_t num_reads = (argc > 4 ? atoi(argv[4]) : 1000000);
+
+	std::cout << "File: " << path << std::endl;
+	std::cout << "Size: " << file_size / pow(1024, 2) << " MiB" << std::endl;
+	std::cout << "Threads: " << num_threads << std::endl;
+
+	std::default_random_engine generator;
+
+	std::vector<uint8_t> data(file_size);
+	for(size_t i = 0; i < data.size(); i += 8) {
+		const uint64_t value = generator();
+		::memcpy(data.data() + i, &value, 8);
+	}
+	bool passed = true;
+	{
+		mad::DirectFile file(path, false, true, true);
+		file.auto_flush_bytes = 0;
+
+		std::cout << "Direct IO: " << (file.is_direct() ? "yes" : "no") << std::endl;
+
+		// write all but the last byte, to keep the tail page in cache
+		{
+			mad::DirectFile::buffer_t buffer;
+			file.write(data.data(), file_size - 1, 0, buffer);
+			data.back() = 0;
+		}
+		mad::DirectFile::buffer_t buffer;
+
+		// large sequential reads
+		{
+			std::vector<uint8_t> tmp(4 * 1024 * 1024 + 1);
+
+			const auto time_begin = get_time_micros();
+			for(uint64_t offset = 0; offset < file_size;) {
+				const auto count = std::min<uint64_t>(tmp.size(), file_size - offset);
+				file.read(tmp.data(), count, offset, buffer);
+				if(::memcmp(tmp.data(), data.data() + offset, count)) {
+					std::cerr << "ERROR: read() wrong data at offset " << offset << std::endl;
+					passed = false;
+				}
+				offset += count;
+			}
+			const auto elapsed = (get_time_micros() - time_begin) / 1e6;
+			std::cout << "Sequential read() took " << elapsed << " sec, " << file_size / elapsed / pow(1024, 2) << " MiB/s" << std::endl;
+		}
+
+		// zero-copy reads, with matching unaligned start
+		{
+			const size_t shift = 100;
+			auto tmp = file.alloc_buffer(4 * 1024 * 1024 + shift);
+
+			const auto time_begin = get_time_micros();
+			for(uint64_t offset = shift; offset < file_size;) {
+				const auto count = std::min<uint64_t>(tmp.size() - shift, file_size - offset);
+				file.read(tmp.data() + shift, count, offset, buffer);
+				if(::memcmp(tmp.data() + shift, data.data() + offset, count)) {
+					std::cerr << "ERROR: zero-copy read() wrong data at offset " << offset << std::endl;
+					passed = false;
+				}
+				offset += count;
+			}
+			const auto elapsed = (get_time_micros() - time_begin) / 1e6;
+			std::cout << "Zero-copy read() took " << elapsed << " sec, " << file_size / elapsed / pow(1024, 2) << " MiB/s" << std::endl;
+		}
+
+		// small random reads, one by one vs. batched
+		std::vector<mad::DirectFile::read_request_t> requests(num_reads);
+		std::vector<uint8_t> result(num_reads * 64);
+		for(size_t i = 0; i < num_reads; ++i) {
+			auto& req = requests[i];
+			req.length = 8 + generator() % 57;
+			req.offset = generator() % (file_size + 4096 - req.length);		// some beyond end of file
+			req.data = result.data() + i * 64;
+		}
+		const auto check = [&](const std::string& name, const size_t count) {
+			for(size_t k = 0; k < count; ++k) {
+				const auto& req = requests[k];
+				for(size_t i = 0; i < req.length; ++i) {
+					const auto pos = req.offset + i;
+					if(((const uint8_t*)req.data)[i] != (pos < file_size ? data[pos] : 0)) {
+						std::cerr << "ERROR: " << name << " wrong data at offset " << req.offset << std::endl;
+						passed = false;
+						return;
+					}
+				}
+			}
+		};
+		const size_t num_single = std::min<size_t>(num_reads, 100000);
+		{
+			const size_t count = num_single;
+			const auto time_begin = get_time_micros();
+			for(size_t i = 0; i < count; ++i) {
+				const auto& req = requests[i];
+				file.read(req.data, req.length, req.offset, buffer);
+			}
+			const auto elapsed = (get_time_micros() - time_begin) / 1e6;
+			std::cout << "Random read() took " << elapsed << " sec, " << count / elapsed << " reads/s" << std::endl;
+		}
+		check("read()", num_single);
+		std::fill(result.begin(), result.end(), 0);
+
+		for(int threads = 1; threads <= num_threads; threads *= 2)
+		{
+			const auto stats_begin = file.get_stats();
+			const auto time_begin = get_time_micros();
+			file.read_batch(requests, threads);
+			const auto elapsed = (get_time_micros() - time_begin) / 1e6;
+			const auto stats = file.get_stats();
+
+			std::cout << "read_batch() with " << threads << " threads took " << elapsed << " sec, " << num_reads / elapsed << " reads/s, "
+					<< stats.num_read - stats_begin.num_read << " device reads" << std::endl;
+
+			check("read_batch()", num_reads);
+			std::fill(result.begin(), result.end(), 0);
+		}
+		file.close();
+	}
+	{
+		mad::DirectFile file(path, false, false);
+		mad::DirectFile::buffer_t buffer;
+
+		std::vector<uint8_t> tmp(1024 * 1024 + 3);
+		const auto time_begin = get_time_micros();
+		for(uint64_t offset = 0; offset < file_size;) {
+			const auto count = std::min<uint64_t>(tmp.size(), file_size - offset);
+			file.read(tmp.data(), count, offset, buffer);
+			if(::memcmp(tmp.data(), data.data() + offset, count)) {
+				std::cerr << "ERROR: read-only read() wrong data at offset " << offset << std::endl;
+				passed = false;
+			}
+			offset += count;
+		}
+		const auto elapsed = (get_time_micros() - time_begin) / 1e6;
+		std::cout << "Read-only read() took " << elapsed << " sec, " << file_size / elapsed / pow(1024, 2) << " MiB/s" << std::endl;
+
+		for(const bool ordered : {false, true})
+		{
+			std::mutex mutex;
+			uint64_t next_offset = 0;
+			uint64_t total = 0;
+			const auto time_begin = get_time_micros();
+			mad::parallel_scan(file, 4 * 1024 * 1024, num_threads,
+				[&](const uint8_t* chunk, const size_t length, const uint64_t offset) {
+					std::lock_guard<std::mutex> lock(mutex);
+					if(::memcmp(chunk, data.data() + offset, length)) {
+						std::cerr << "ERROR: parallel_scan() wrong data at offset " << offset << std::endl;
+						passed = false;
+					}
+					if(ordered && offset != next_offset) {
+						std::cerr << "ERROR: parallel_scan() out of order at offset " << offset << std::endl;
+						passed = false;
+					}
+					next_offset = offset + length;
+					total += length;
+				}, ordered);
+			const auto elapsed = (get_time_micros() - time_begin) / 1e6;
+
+			if(total != file_size) {
+				std::cerr << "ERROR: parallel_scan() covered " << total << " bytes" << std::endl;
+				passed = false;
+			}
+			std::cout << "parallel_scan() " << (ordered ? "ordered" : "unordered") << " took " << elapsed << " sec, "
+					<< file_size / elapsed / pow(1024, 2) << " MiB/s" << std::endl;
+		}
+
+		try {
+			file.write(tmp.data(), 1, 0, buffer);
+			std::cerr << "ERROR: write() on read-only file did not throw" << std::endl;
+			passed = false;
+		} catch(const std::logic_error&) {
+			// expected
+		}
+		file.close();
+	}
+	{
+		mad::DirectFile file(path, true, true);
+		file.enable_read_cache(16 * 1024 * 1024);
+		file.auto_flush_bytes = 1024 * 1024;
+
+		// hot set of 4 MiB with a scan in between, plus small over-writes to check invalidation
+		const uint64_t hot_size = std::min<uint64_t>(file_size, 4 * 1024 * 1024);
+		const size_t count = std::min<size_t>(num_reads, 200000);
+
+		mad::DirectFile::buffer_t buffer;
+		std::vector<uint8_t> tmp(64 * 1024);
+
+		const auto time_begin = get_time_micros();
+		for(size_t i = 0; i < count && passed; ++i)
+		{
+			uint64_t offset = 0;
+			size_t length = 0;
+			if(i % 4 == 3) {
+				length = 64 * 1024;
+				offset = (i * length) % (file_size - length);		// scan
+			} else {
+				length = 1 + generator() % 256;
+				offset = generator() % (hot_size - length);
+			}
+			if(i % 64 == 0) {
+				const auto value = uint8_t(generator());
+				std::fill(data.begin() + offset, data.begin() + offset + length, value);
+				file.write(data.data() + offset, length, offset, buffer);
+			}
+			file.read(tmp.data(), length, offset, buffer);
+			if(::memcmp(tmp.data(), data.data() + offset, length)) {
+				std::cerr << "ERROR: cached read() wrong data at offset " << offset << std::endl;
+				passed = false;
+			}
+		}
+		const auto elapsed = (get_time_micros() - time_begin) / 1e6;
+		const auto stats = file.get_stats();
+
+		std::cout << "Cached read() took " << elapsed << " sec, " << count / elapsed << " reads/s, "
+				<< stats.num_read << " device reads, hit rate "
+				<< 100. * stats.read_cache_hit / std::max<uint64_t>(stats.read_cache_hit + stats.read_cache_miss, 1) << " %" << std::endl;
+
+		// small pieces, sequential and strided, served by read-ahead
+		for(const uint64_t stride : {uint64_t(1000), uint64_t(48 * 1024)})
+		{
+			const size_t length = 1000;
+			const auto stats_begin = file.get_stats();
+			const auto time_begin = get_time_micros();
+			size_t num_pieces = 0;
+			for(uint64_t offset = 0; offset + length <= file_size && passed; offset += stride) {
+				file.read(tmp.data(), length, offset, buffer);
+				if(::memcmp(tmp.data(), data.data() + offset, length)) {
+					std::cerr << "ERROR: stream read() wrong data at offset " << offset << std::endl;
+					passed = false;
+				}
+				num_pieces++;
+			}
+			const auto elapsed = (get_time_micros() - time_begin) / 1e6;
+			const auto stats = file.get_stats();
+
+			std::cout << "Stream read() with stride " << stride << " took " << elapsed << " sec, " << num_pieces / elapsed << " reads/s, "
+					<< stats.num_read - stats_begin.num_read << " device reads, "
+					<< stats.num_read_ahead - stats_begin.num_read_ahead << " read-ahead" << std::endl;
+		}
+
+		// explicit prefetch, then read from memory
+		{
+			const uint64_t offset = file_size / 2 + 12345;
+			const uint64_t length = std::min<uint64_t>(file_size / 4, 8 * 1024 * 1024);
+			file.advise(0, file_size, mad::DirectFile::ADVISE_DONTNEED);
+
+			const auto time_begin = get_time_micros();
+			file.prefetch(offset, length).get();
+			const auto elapsed = (get_time_micros() - time_begin) / 1e6;
+
+			const auto stats_begin = file.get_stats();
+			for(uint64_t pos = offset; pos < offset + length && passed;) {
+				const auto count = std::min<uint64_t>(tmp.size(), offset + length - pos);
+				file.read(tmp.data(), count, pos, buffer);
+				if(::memcmp(tmp.data(), data.data() + pos, count)) {
+					std::cerr << "ERROR: prefetched read() wrong data at offset " << pos << std::endl;
+					passed = false;
+				}
+				pos += count;
+			}
+			const auto stats = file.get_stats();
+			std::cout << "prefetch() took " << elapsed << " sec, " << length / elapsed / pow(1024, 2) << " MiB/s, "
+					<< stats.num_read - stats_begin.num_read << " device reads after" << std::endl;
+		}
+
+		// views, one from read cache which is over-written afterwards, one large
+		{
+			const uint64_t offset = 4096 * 10 + 17;
+			const size_t length = 100;
+			std::vector<uint8_t> tmp(length);
+			file.read(tmp.data(), length, offset, buffer);		// to load into cache
+
+			auto small = file.read_view(offset, length);
+			auto large = file.read_view(offset, 3 * 1024 * 1024);
+			if(small.length != length || ::memcmp(small.data, data.data() + offset, length)
+				|| ::memcmp(large.data, data.data() + offset, large.length))
+			{
+				std::cerr << "ERROR: read_view() wrong data" << std::endl;
+				passed = false;
+			}
+			const std::vector<uint8_t> old(data.begin() + offset, data.begin() + offset + length);
+			std::fill(data.begin() + offset, data.begin() + offset + length, 0xAB);
+			file.write(data.data() + offset, length, offset, buffer);
+			file.flush();
+
+			if(::memcmp(small.data, old.data(), length)) {
+				std::cerr << "ERROR: read_view() data changed by write()" << std::endl;
+				passed = false;
+			}
+			small.release();
+			large.release();
+
+			const auto view = file.read_view(offset, length);
+			if(::memcmp(view.data, data.data() + offset, length)) {
+				std::cerr << "ERROR: read_view() after write() wrong data" << std::endl;
+				passed = false;
+			}
+		}
+
+		// asynchronous read into supplied buffer
+		{
+			std::vector<uint8_t> out(3 * 1024 * 1024 + 7);
+			const uint64_t offset = 777;
+			auto future = file.read_async(out.data(), out.size(), offset);
+			future.get();
+			if(::memcmp(out.data(), data.data() + offset, out.size())) {
+				std::cerr << "ERROR: read_async() wrong data" << std::endl;
+				passed = false;
+			}
+		}
+		file.close();
+	}
+	::remove(path.c_str());
+
+	// sparse file: data at begin, middle and end, holes in between
+	{
+		const uint64_t chunk = 1024 * 1024;
+		const std::vector<uint64_t> offsets = {0, file_size / 2 + 4096 * 3 + 5, file_size - chunk};
+		{
+			mad::DirectFile file(path, false, true, true);
+			mad::DirectFile::buffer_t buffer;
+			for(const auto offset : offsets) {
+				file.write(data.data() + offset, chunk, offset, buffer);
+			}
+			file.close();
+		}
+		std::vector<uint8_t> expect(file_size);
+		for(const auto offset : offsets) {
+			::memcpy(expect.data() + offset, data.data() + offset, chunk);
+		}
+		mad::DirectFile file(path, false, false);
+		file.sparse_read = true;
+		mad::DirectFile::buffer_t buffer;
+
+		std::vector<uint8_t> tmp(1024 * 1024 + 3);
+		const auto time_begin = get_time_micros();
+		for(uint64_t offset = 0; offset < file_size;) {
+			const auto count = std::min<uint64_t>(tmp.size(), file_size - offset);
+			file.read(tmp.data(), count, offset, buffer);
+			if(::memcmp(tmp.data(), expect.data() + offset, count)) {
+				std::cerr << "ERROR: sparse read() wrong data at offset " << offset << std::endl;
+				passed = false;
+			}
+			offset += count;
+		}
+		const auto elapsed = (get_time_micros() - time_begin) / 1e6;
+		const auto stats = file.get_stats();
+		std::cout << "Sparse read() took " << elapsed << " sec, " << file_size / elapsed / pow(1024, 2) << " MiB/s, "
+				<< stats.bytes_read / pow(1024, 2) << " MiB read, " << stats.bytes_hole / pow(1024, 2) << " MiB holes" << std::endl;
+		file.close();
+	}
+	::remove(path.c_str());
+
+	if(!passed) {
+		std::cout << "Verify FAILED" << std::endl;
+		return 1;
+	}
+	std::cout << "Verify passed" << std::endl;
+	return 0;
+}
+
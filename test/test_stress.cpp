@@ -0,0 +1,354 @@
+/*
+ * test_stress.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: mad
+ */
+
+#include <mad/DirectFile.h>
+
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <vector>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+#include <getopt.h>
+
+/*
+ * Randomized multi-threaded writes against a shadow model of the file.
+ *
+ * Each round issues a set of byte-disjoint writes in random order from all threads,
+ * with ranges that share pages, start / end unaligned or are page aligned.
+ * Writes of later rounds over-write data of earlier rounds, which may still be cached.
+ * Threads randomly flush in between. Every few rounds the file is flushed and verified byte-for-byte,
+ * in between pages cached in one round stay cached into the next.
+ *
+ * With stream mode, overlapping re-writes of data staged behind a gap are tested as well, see test_overlap().
+ */
+
+struct write_t {
+	uint64_t offset = 0;
+	uint64_t length = 0;
+	uint64_t seed = 0;
+};
+
+struct config_t {
+	uint64_t file_size = 64 << 20;
+	int num_threads = 8;
+	int num_rounds = 20;
+	int verify_interval = 4;
+	int log_page_size = 12;
+	size_t buffer_size = 256 * 1024;
+	size_t auto_flush_bytes = 256 * 1024;
+	double flush_prob = 0.01;
+	bool sequential_write = false;
+	size_t stream_window = 0;
+	size_t write_behind_bytes = 0;		// 0 = Direct IO (if supported)
+	uint64_t seed = 1;
+};
+
+static
+void fill(uint8_t* data, const uint64_t length, const uint64_t seed)
+{
+	std::mt19937_64 generator(seed);
+	for(uint64_t i = 0; i < length; i += 8) {
+		const auto value = generator();
+		::memcpy(data + i, &value, std::min<uint64_t>(length - i, 8));
+	}
+}
+
+static
+std::vector<write_t> generate_round(const config_t& config, std::mt19937_64& generator)
+{
+	const uint64_t page_size = uint64_t(1) << config.log_page_size;
+
+	std::vector<write_t> out;
+	uint64_t offset = generator() % (2 * page_size);
+	while(offset < config.file_size)
+	{
+		uint64_t length = 0;
+		switch(generator() % 5) {
+			case 0: length = 1 + generator() % 64; break;							// tiny
+			case 1: length = 1 + generator() % (2 * page_size); break;				// around a page
+			case 2: length = 1 + generator() % (64 * page_size); break;				// medium
+			case 3: length = 1 + generator() % (2 * config.buffer_size); break;		// large
+			case 4:
+				// aligned
+				offset = (offset + page_size - 1) & ~(page_size - 1);
+				length = (1 + generator() % 64) * page_size;
+				break;
+		}
+		length = std::min(length, config.file_size - std::min(offset, config.file_size));
+		if(length) {
+			write_t entry;
+			entry.offset = offset;
+			entry.length = length;
+			entry.seed = generator();
+			out.push_back(entry);
+		}
+		offset += length;
+
+		// mostly adjacent, sometimes leave a gap
+		if(generator() % 4 == 0) {
+			offset += generator() % (4 * page_size);
+		}
+	}
+	std::shuffle(out.begin(), out.end(), generator);
+	return out;
+}
+
+static
+bool verify(const std::string& path, const std::vector<uint8_t>& model, const int round)
+{
+	FILE* file = ::fopen(path.c_str(), "rb");
+	if(!file) {
+		throw std::runtime_error("fopen() failed");
+	}
+	std::vector<uint8_t> buffer(model.size());
+	const auto count = ::fread(buffer.data(), 1, buffer.size(), file);
+	::fclose(file);
+
+	// not yet written tail reads as zero
+	std::fill(buffer.begin() + count, buffer.end(), 0);
+
+	for(size_t i = 0; i < model.size(); ++i) {
+		if(buffer[i] != model[i]) {
+			size_t end = i;
+			while(end < model.size() && buffer[end] != model[end]) {
+				end++;
+			}
+			std::cerr << "ERROR: round " << round << ": wrong data at offset " << i << " (" << end - i << " bytes)" << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+ * Stream mode only: write a range behind a gap (so it is staged), over-write parts of it
+ * (same start but shorter, or straddling its end), then fill the gap. Repeated at increasing offsets.
+ */
+static
+bool test_overlap(const std::string& path, const config_t& config, std::mt19937_64& generator)
+{
+	const uint64_t page_size = uint64_t(1) << config.log_page_size;
+	const uint64_t window = config.stream_window;
+
+	std::vector<uint8_t> model(config.file_size);
+	std::vector<uint8_t> data;
+
+	::remove(path.c_str());
+	{
+		mad::DirectFile file(path, true, true, true, config.log_page_size, config.buffer_size);
+		file.auto_flush_bytes = config.auto_flush_bytes;
+		file.enable_stream(window);
+		file.stream_timeout_ms = 1000;		// single writer, gaps are always filled
+		if(config.write_behind_bytes) {
+			file.disable_direct_io();
+			file.write_behind_bytes = config.write_behind_bytes;
+		}
+
+		mad::DirectFile::buffer_t buffer;
+		uint64_t pos = 0;
+		uint64_t max_end = 0;		// continue there, to not leave a gap behind
+		const auto write = [&](const uint64_t offset, const uint64_t length) {
+			write_t entry;
+			entry.offset = offset;
+			entry.length = std::min(length, config.file_size - std::min(offset, config.file_size));
+			entry.seed = generator();
+			if(entry.length) {
+				data.resize(entry.length);
+				fill(data.data(), entry.length, entry.seed);
+				file.write(data.data(), entry.length, entry.offset, buffer);
+				fill(model.data() + entry.offset, entry.length, entry.seed);
+				max_end = std::max(max_end, entry.offset + entry.length);
+			}
+		};
+		while(pos < config.file_size)
+		{
+			const auto head = 1 + generator() % page_size;
+			const auto gap_end = pos + head + 1 + generator() % (window / 8);
+			const auto length = 1 + generator() % (window / 4);
+
+			write(pos, head);
+			write(gap_end, length);
+			for(int i = 0; i < 2; ++i) {
+				if(generator() % 2) {
+					write(gap_end, 1 + generator() % length);
+				} else {
+					write(gap_end + generator() % length, length);
+				}
+			}
+			write(pos + head, gap_end - (pos + head));
+
+			pos = max_end;
+		}
+		file.close();
+	}
+	const auto passed = verify(path, model, -1);
+	::remove(path.c_str());
+	return passed;
+}
+
+static
+void print_usage()
+{
+	std::cerr << "Usage: test_stress [options] <file>" << std::endl;
+	std::cerr << "  -s <MiB>      file size (default 64)" << std::endl;
+	std::cerr << "  -t <count>    threads (default 8)" << std::endl;
+	std::cerr << "  -r <count>    rounds (default 20)" << std::endl;
+	std::cerr << "  -v <count>    flush and verify every N rounds (default 4)" << std::endl;
+	std::cerr << "  -p <log>      log_page_size (default 12)" << std::endl;
+	std::cerr << "  -b <KiB>      buffer_size (default 256)" << std::endl;
+	std::cerr << "  -f <KiB>      auto_flush_bytes (default 256)" << std::endl;
+	std::cerr << "  -F <prob>     flush probability per write (default 0.01)" << std::endl;
+	std::cerr << "  -q            enable sequential_write" << std::endl;
+	std::cerr << "  -w <KiB>      enable stream mode with window size (default off)" << std::endl;
+	std::cerr << "  -B <KiB>      use buffered mode with write_behind_bytes (default off)" << std::endl;
+	std::cerr << "  -S <seed>     random seed (default 1)" << std::endl;
+}
+
+
+int main(int argc, char** argv)
+{
+	config_t config;
+
+	int c = 0;
+	while((c = ::getopt(argc, argv, "s:t:r:v:p:b:f:F:qw:B:S:h")) != -1)
+	{
+		switch(c) {
+			case 's': config.file_size = uint64_t(atoll(optarg)) << 20; break;
+			case 't': config.num_threads = std::max(atoi(optarg), 1); break;
+			case 'r': config.num_rounds = atoi(optarg); break;
+			case 'v': config.verify_interval = std::max(atoi(optarg), 1); break;
+			case 'p': config.log_page_size = atoi(optarg); break;
+			case 'b': config.buffer_size = size_t(atoll(optarg)) * 1024; break;
+			case 'f': config.auto_flush_bytes = size_t(atoll(optarg)) * 1024; break;
+			case 'F': config.flush_prob = atof(optarg); break;
+			case 'q': config.sequential_write = true; break;
+			case 'w': config.stream_window = size_t(atoll(optarg)) * 1024; break;
+			case 'B': config.write_behind_bytes = std::max<size_t>(atoll(optarg), 1) * 1024; break;
+			case 'S': config.seed = atoll(optarg); break;
+			default:
+				print_usage();
+				return -1;
+		}
+	}
+	if(argc - optind != 1) {
+		print_usage();
+		return -1;
+	}
+	const std::string path(argv[optind]);
+
+	std::cout << "File: " << path << ", Size: " << config.file_size / pow(1024, 2) << " MiB, Threads: " << config.num_threads
+			<< ", Rounds: " << config.num_rounds << ", Seed: " << config.seed << std::endl;
+
+	::remove(path.c_str());
+
+	std::mt19937_64 generator(config.seed);
+	std::vector<uint8_t> model(config.file_size);
+
+	bool passed = true;
+	uint64_t total_writes = 0;
+	{
+		// read_flag = true since we over-write existing data
+		mad::DirectFile file(path, true, true, true, config.log_page_size, config.buffer_size);
+		file.auto_flush_bytes = config.auto_flush_bytes;
+		file.sequential_write = config.sequential_write;
+		if(config.stream_window) {
+			file.enable_stream(config.stream_window);
+			file.stream_timeout_ms = 5;		// rounds are random, gaps are common
+		}
+		if(config.write_behind_bytes) {
+			file.disable_direct_io();
+			file.write_behind_bytes = config.write_behind_bytes;
+		}
+
+		std::cout << "Direct IO: " << (file.is_direct() ? "yes" : "no") << std::endl;
+
+		for(int round = 0; round < config.num_rounds && passed; ++round)
+		{
+			const auto list = generate_round(config, generator);
+
+			std::mutex mutex;
+			size_t next = 0;
+			std::vector<std::thread> threads;
+
+			for(int i = 0; i < config.num_threads; ++i)
+			{
+				const auto seed = generator();
+				threads.emplace_back([&, seed]()
+				{
+					std::mt19937_64 generator(seed);
+					std::uniform_real_distribution<double> dist(0, 1);
+					mad::DirectFile::buffer_t buffer;
+					std::vector<uint8_t> data;
+
+					while(true) {
+						size_t index = 0;
+						{
+							std::lock_guard<std::mutex> lock(mutex);
+							if(next >= list.size()) {
+								break;
+							}
+							index = next++;
+						}
+						const auto& entry = list[index];
+
+						// use an unaligned source buffer half of the time
+						const auto shift = generator() % 2;
+						data.resize(entry.length + shift);
+						fill(data.data() + shift, entry.length, entry.seed);
+
+						file.write(data.data() + shift, entry.length, entry.offset, buffer);
+
+						if(dist(generator) < config.flush_prob) {
+							file.flush();
+						}
+					}
+				});
+			}
+			for(auto& thread : threads) {
+				thread.join();
+			}
+
+			// apply to model (byte-disjoint within a round, so order does not matter)
+			for(const auto& entry : list) {
+				fill(model.data() + entry.offset, entry.length, entry.seed);
+			}
+			total_writes += list.size();
+
+			if((round + 1) % config.verify_interval == 0) {
+				file.flush();
+				passed = verify(path, model, round);
+			}
+		}
+		file.close();
+
+		const auto stats = file.get_stats();
+		std::cout << "Writes: " << total_writes << ", pwrite: " << stats.num_pwrite << ", flush pwrite: " << stats.num_pwrite_flush
+				<< ", pread: " << stats.num_pread << ", lock waits: " << stats.num_lock_wait
+				<< ", stream emits: " << stats.num_stream_emit << ", write-behind: " << stats.num_write_behind << std::endl;
+	}
+	if(passed) {
+		passed = verify(path, model, config.num_rounds);
+	}
+	::remove(path.c_str());
+
+	if(passed && config.stream_window) {
+		passed = test_overlap(path, config, generator);
+		std::cout << "Overlapping re-writes: " << (passed ? "passed" : "FAILED") << std::endl;
+	}
+
+	if(!passed) {
+		std::cout << "Stress test FAILED" << std::endl;
+		return 1;
+	}
+	std::cout << "Stress test passed" << std::endl;
+	return 0;
+}
+
@@ -7,6 +7,8 @@
 
 #include <mad/DirectFile.h>
 
+#include "PerfCounters.h"
+
 #include <cmath>
 #include <cstdio>
 #include <iostream>
@@ -15,12 +17,57 @@
 #include <chrono>
 #include <mutex>
 #include <thread>
+#include <memory>
 
 inline
 int64_t get_time_micros() {
 	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
 }
 
+/*
+ * Small sequential writes from `num_threads` threads (one region each) with a rate limit, returns MiB/s achieved.
+ * Only the thread that flushes should wait for the limit, so throughput has to stay close to it.
+ */
+static
+double test_rate_limit(const std::string& path, const uint64_t rate_limit, const int num_threads, double& throttle_sec)
+{
+	const size_t total_size = 2 * rate_limit;		// ~2 sec
+	const size_t write_size = 1000;
+	const size_t num_writes = total_size / write_size / num_threads;
+
+	::remove(path.c_str());
+
+	const auto time_begin = get_time_micros();
+	{
+		mad::DirectFile file(path, false, true, true);
+		file.set_rate_limit(rate_limit);
+
+		std::vector<std::thread> threads;
+		for(int i = 0; i < num_threads; ++i)
+		{
+			threads.emplace_back([&file, i, num_threads, num_writes, write_size]()
+			{
+				mad::DirectFile::buffer_t buffer;
+				std::vector<uint8_t> data(write_size, uint8_t(i));
+
+				for(size_t k = 0; k < num_writes; ++k) {
+					file.write(data.data(), data.size(), (i * num_writes + k) * write_size, buffer);
+				}
+			});
+		}
+		for(auto& thread : threads) {
+			thread.join();
+		}
+		file.close();
+
+		throttle_sec = file.get_stats().throttle_ns / 1e9;
+	}
+	const auto elapsed = (get_time_micros() - time_begin) / 1e6;
+
+	::remove(path.c_str());
+	return num_writes * num_threads * write_size / elapsed / pow(1024, 2);
+}
+
 
 int main(int argc, char** argv)
 {
@@ -33,6 +80,10 @@ int main(int argc, char** argv)
 
 	const uint64_t file_size = uint64_t(argc > 2 ? atoi(argv[2]) : 1024) * 1024 * 1024;
 	const int num_threads = (argc > 3 ? atoi(argv[3]) : 8);
+	const std::string trace_path(argc > 4 ? argv[4] : "");	// *.json for Chrome trace
+	const bool is_json = trace_path.size() > 5 && trace_path.substr(trace_path.size() - 5) == ".json";
+	const size_t stream_window = size_t(argc > 5 ? atoi(argv[5]) : 0) * 1024 * 1024;		// 0 = no stream mode
+	const uint64_t rate_limit = uint64_t(argc > 6 ? atoi(argv[6]) : 0) * 1024 * 1024;		// MiB/s (0 = unlimited)
 
 	std::cout << "File: " << path << std::endl;
 	std::cout << "Size: " << file_size / pow(1024, 3) << " GiB" << std::endl;
@@ -46,12 +97,33 @@ int main(int argc, char** argv)
 	}
 	const size_t data_size = data.size() * 8;
 
+	PerfCounters perf;
+	perf.start();
+
+	std::unique_ptr<mad::IOTrace> trace;
+	mad::DirectFile::stats_t stats;
+
 	const auto time_begin = get_time_micros();
 	{
 		mad::DirectFile file(path, false, true, true);
 
+		if(!trace_path.empty()) {
+			trace.reset(new mad::IOTrace());
+			trace->detail = is_json;
+			file.trace = trace.get();
+		}
+
 		std::cout << "Direct IO: " << (file.is_direct() ? "yes" : "no") << std::endl;
 
+		if(stream_window) {
+			file.enable_stream(stream_window);
+			std::cout << "Stream window: " << stream_window / pow(1024, 2) << " MiB" << std::endl;
+		}
+		if(rate_limit) {
+			file.set_device_rate_limit(rate_limit);
+			std::cout << "Rate limit: " << rate_limit / pow(1024, 2) << " MiB/s" << std::endl;
+		}
+
 		std::mutex mutex;
 		uint64_t offset = 0;
 		std::vector<std::thread> threads;
@@ -95,11 +167,30 @@ int main(int argc, char** argv)
 			thread.join();
 		}
 		file.close();
+
+		perf.stop();
+
+		stats = file.get_stats();
 	}
 	const auto time_end = get_time_micros();
 
+	std::cout << "pwrite: " << stats.num_pwrite << ", flush pwrite: " << stats.num_pwrite_flush
+			<< ", stream emits: " << stats.num_stream_emit << ", stream waits: " << stats.num_stream_wait << std::endl;
+	if(rate_limit) {
+		std::cout << "Throttled: " << stats.num_throttled << " times, " << stats.throttle_ns / 1e9 << " sec" << std::endl;
+	}
+	if(trace) {
+		if(is_json) {
+			trace->save_chrome_trace(trace_path);
+		} else {
+			trace->save(trace_path);
+		}
+		std::cout << "Saved trace to " << trace_path << std::endl;
+	}
+
 	const auto elapsed = (time_end - time_begin) / 1e6;
 	std::cout << "Took " << elapsed << " sec, " << file_size / elapsed / pow(1024, 2) << " MiB/s" << std::endl;
+	perf.print(std::cout, file_size);
 
 	{
 		FILE* file = fopen(path.c_str(), "rb");
@@ -124,7 +215,20 @@ int main(int argc, char** argv)
 	}
 	std::cout << "Verify passed" << std::endl;
 
-	return 0;
+	bool failed = false;
+	if(rate_limit) {
+		for(const int count : {1, num_threads}) {
+			double throttle_sec = 0;
+			const auto rate = test_rate_limit(path, rate_limit, count, throttle_sec);
+			std::cout << "Small writes with " << count << " threads: " << rate << " MiB/s, throttled "
+					<< throttle_sec << " sec" << std::endl;
+			if(rate < 0.9 * rate_limit / pow(1024, 2)) {
+				std::cerr << "ERROR: rate limit throughput too low with " << count << " threads" << std::endl;
+				failed = true;
+			}
+		}
+	}
+	return failed ? 1 : 0;
 }
 
 
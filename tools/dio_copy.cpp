@@ -0,0 +1,463 @@
+/*
+ * dio_copy.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: mad
+ */
+
+#include <mad/DirectFile.h>
+
+#include <cmath>
+#include <cstdio>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+inline
+int64_t get_time_micros() {
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline
+uint64_t hash_chunk(const uint8_t* data, const size_t length)
+{
+	uint64_t hash = 0xcbf29ce484222325ull;
+	size_t i = 0;
+	for(; i + 8 <= length; i += 8) {
+		uint64_t word;
+		::memcpy(&word, data + i, 8);
+		hash = (hash ^ word) * 0x100000001b3ull;
+		hash ^= hash >> 29;
+	}
+	for(; i < length; ++i) {
+		hash = (hash ^ data[i]) * 0x100000001b3ull;
+	}
+	return hash;
+}
+
+struct options_t {
+	int num_threads = 8;
+	size_t chunk_size = 4 * 1024 * 1024;
+	double limit_MBps = 0;		// 0 = unlimited
+	bool verify = false;
+	bool progress = false;
+	bool compare_cp = false;
+};
+
+struct copy_job_t {
+	std::string src;
+	std::string dst;
+	uint64_t size = 0;
+};
+
+/*
+ * Paces all copy threads to a maximum bandwidth.
+ */
+class Throttle {
+public:
+	Throttle(const double limit_MBps)
+		:	bytes_per_usec(limit_MBps * 1024 * 1024 / 1e6)
+	{
+		time_begin = get_time_micros();
+	}
+
+	void consume(const size_t bytes)
+	{
+		if(bytes_per_usec <= 0) {
+			return;
+		}
+		int64_t deadline = 0;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			total += bytes;
+			deadline = time_begin + int64_t(total / bytes_per_usec);
+		}
+		const auto now = get_time_micros();
+		if(deadline > now) {
+			std::this_thread::sleep_for(std::chrono::microseconds(deadline - now));
+		}
+	}
+
+private:
+	const double bytes_per_usec;
+	int64_t time_begin = 0;
+	uint64_t total = 0;
+	std::mutex mutex;
+};
+
+static
+int open_source(const std::string& path)
+{
+	int fd = ::open(path.c_str(), O_RDONLY | O_DIRECT);
+	if(fd < 0) {
+		fd = ::open(path.c_str(), O_RDONLY);
+	}
+	if(fd < 0) {
+		throw std::runtime_error("open(" + path + ") failed with: " + std::string(std::strerror(errno)));
+	}
+	return fd;
+}
+
+static
+void read_chunk(const int fd, uint8_t* buffer, const size_t count, const uint64_t offset, const std::string& path)
+{
+	// direct reads have to be issued with page aligned length, EOF ends it short
+	const size_t aligned = (count + 4095) & ~size_t(4095);
+	size_t total = 0;
+	while(total < count) {
+		const auto ret = ::pread(fd, buffer + total, aligned - total, offset + total);
+		if(ret < 0) {
+			throw std::runtime_error("pread(" + path + ") failed with: " + std::string(std::strerror(errno)));
+		}
+		if(ret == 0) {
+			throw std::runtime_error("unexpected EOF in " + path + " at offset " + std::to_string(offset + total));
+		}
+		total += ret;
+	}
+}
+
+static
+void collect_jobs(const std::string& src, const std::string& dst, std::vector<copy_job_t>& jobs)
+{
+	struct stat info = {};
+	if(::stat(src.c_str(), &info) < 0) {
+		throw std::runtime_error("stat(" + src + ") failed with: " + std::string(std::strerror(errno)));
+	}
+	if(S_ISDIR(info.st_mode)) {
+		if(::mkdir(dst.c_str(), info.st_mode & 07777) < 0 && errno != EEXIST) {
+			throw std::runtime_error("mkdir(" + dst + ") failed with: " + std::string(std::strerror(errno)));
+		}
+		DIR* dir = ::opendir(src.c_str());
+		if(!dir) {
+			throw std::runtime_error("opendir(" + src + ") failed with: " + std::string(std::strerror(errno)));
+		}
+		std::vector<std::string> names;
+		while(auto entry = ::readdir(dir)) {
+			const std::string name(entry->d_name);
+			if(name != "." && name != "..") {
+				names.push_back(name);
+			}
+		}
+		::closedir(dir);
+
+		std::sort(names.begin(), names.end());
+		for(const auto& name : names) {
+			collect_jobs(src + "/" + name, dst + "/" + name, jobs);
+		}
+	} else if(S_ISREG(info.st_mode)) {
+		copy_job_t job;
+		job.src = src;
+		job.dst = dst;
+		job.size = info.st_size;
+		jobs.push_back(job);
+	} else {
+		std::cerr << "Skipping non-regular file: " << src << std::endl;
+	}
+}
+
+/*
+ * Copies one file with `num_threads` chunks in flight.
+ * Returns per-chunk checksums of the source data.
+ */
+static
+std::vector<uint64_t> copy_file(const copy_job_t& job, const options_t& opt, Throttle& throttle, std::atomic<uint64_t>& progress)
+{
+	const uint64_t num_chunks = (job.size + opt.chunk_size - 1) / opt.chunk_size;
+	std::vector<uint64_t> checksums(num_chunks);
+
+	const int src_fd = open_source(job.src);
+
+	::remove(job.dst.c_str());
+	{
+		mad::DirectFile file(job.dst, false, true, true, 12, opt.chunk_size);
+
+		std::mutex mutex;
+		uint64_t next_chunk = 0;
+		std::exception_ptr error;
+		std::vector<std::thread> threads;
+
+		for(int i = 0; i < opt.num_threads; ++i)
+		{
+			threads.emplace_back([&]()
+			{
+				mad::DirectFile::buffer_t buffer;
+				uint8_t* data = (uint8_t*)::aligned_alloc(4096, opt.chunk_size);
+				try {
+					while(true) {
+						uint64_t chunk = 0;
+						{
+							std::lock_guard<std::mutex> lock(mutex);
+							if(next_chunk >= num_chunks || error) {
+								break;
+							}
+							chunk = next_chunk++;
+						}
+						const auto offset = chunk * opt.chunk_size;
+						const auto count = std::min<uint64_t>(opt.chunk_size, job.size - offset);
+
+						throttle.consume(count);
+						read_chunk(src_fd, data, count, offset, job.src);
+
+						checksums[chunk] = hash_chunk(data, count);
+
+						file.write(data, count, offset, buffer);
+						progress += count;
+					}
+				} catch(...) {
+					std::lock_guard<std::mutex> lock(mutex);
+					error = std::current_exception();
+				}
+				::free(data);
+			});
+		}
+		for(auto& thread : threads) {
+			thread.join();
+		}
+		::close(src_fd);
+
+		if(error) {
+			std::rethrow_exception(error);
+		}
+		file.close();
+	}
+	// last page is always written in full
+	if(::truncate(job.dst.c_str(), job.size) < 0) {
+		throw std::runtime_error("truncate(" + job.dst + ") failed with: " + std::string(std::strerror(errno)));
+	}
+	return checksums;
+}
+
+/*
+ * Re-reads the destination and compares per-chunk checksums.
+ */
+static
+bool verify_file(const copy_job_t& job, const options_t& opt, const std::vector<uint64_t>& checksums)
+{
+	const int fd = open_source(job.dst);
+
+	std::mutex mutex;
+	uint64_t next_chunk = 0;
+	bool passed = true;
+	std::exception_ptr error;
+	std::vector<std::thread> threads;
+
+	for(int i = 0; i < opt.num_threads; ++i)
+	{
+		threads.emplace_back([&]()
+		{
+			uint8_t* data = (uint8_t*)::aligned_alloc(4096, opt.chunk_size);
+			try {
+				while(true) {
+					uint64_t chunk = 0;
+					{
+						std::lock_guard<std::mutex> lock(mutex);
+						if(next_chunk >= checksums.size() || error) {
+							break;
+						}
+						chunk = next_chunk++;
+					}
+					const auto offset = chunk * opt.chunk_size;
+					const auto count = std::min<uint64_t>(opt.chunk_size, job.size - offset);
+
+					read_chunk(fd, data, count, offset, job.dst);
+
+					if(hash_chunk(data, count) != checksums[chunk]) {
+						std::lock_guard<std::mutex> lock(mutex);
+						std::cerr << "ERROR: checksum mismatch in " << job.dst << " at offset " << offset << std::endl;
+						passed = false;
+					}
+				}
+			} catch(...) {
+				std::lock_guard<std::mutex> lock(mutex);
+				error = std::current_exception();
+			}
+			::free(data);
+		});
+	}
+	for(auto& thread : threads) {
+		thread.join();
+	}
+	::close(fd);
+
+	if(error) {
+		std::rethrow_exception(error);
+	}
+	return passed;
+}
+
+/*
+ * Run command without a shell (so paths need no quoting), returns exit status or -1.
+ */
+static
+int run_command(const std::vector<std::string>& args)
+{
+	std::vector<char*> argv;
+	for(const auto& arg : args) {
+		argv.push_back(const_cast<char*>(arg.c_str()));
+	}
+	argv.push_back(nullptr);
+
+	const pid_t pid = ::fork();
+	if(pid < 0) {
+		return -1;
+	}
+	if(pid == 0) {
+		::execvp(argv[0], argv.data());
+		::_exit(127);
+	}
+	int status = 0;
+	if(::waitpid(pid, &status, 0) < 0 || !WIFEXITED(status)) {
+		return -1;
+	}
+	return WEXITSTATUS(status);
+}
+
+static
+void print_usage()
+{
+	std::cerr << "Usage: dio_copy [options] <source> <destination>" << std::endl;
+	std::cerr << "  -t <count>    number of threads / direct IOs in flight (default 8)" << std::endl;
+	std::cerr << "  -c <KiB>      chunk size per IO (default 4096)" << std::endl;
+	std::cerr << "  -l <MiB/s>    throttle bandwidth (default 0 = unlimited)" << std::endl;
+	std::cerr << "  -v            verify destination checksum after copy" << std::endl;
+	std::cerr << "  -p            report progress" << std::endl;
+	std::cerr << "  -C            compare against `cp` + `sync` on the same source" << std::endl;
+}
+
+
+int main(int argc, char** argv)
+{
+	options_t opt;
+
+	int c = 0;
+	while((c = ::getopt(argc, argv, "t:c:l:vpCh")) != -1)
+	{
+		switch(c) {
+			case 't': opt.num_threads = std::max(atoi(optarg), 1); break;
+			case 'c': opt.chunk_size = std::max<size_t>(atoll(optarg), 4) * 1024; break;
+			case 'l': opt.limit_MBps = atof(optarg); break;
+			case 'v': opt.verify = true; break;
+			case 'p': opt.progress = true; break;
+			case 'C': opt.compare_cp = true; break;
+			default:
+				print_usage();
+				return -1;
+		}
+	}
+	if(argc - optind != 2) {
+		print_usage();
+		return -1;
+	}
+	const std::string src(argv[optind]);
+	std::string dst(argv[optind + 1]);
+	{
+		// copy into existing directory, like cp
+		struct stat info = {};
+		if(::stat(dst.c_str(), &info) == 0 && S_ISDIR(info.st_mode)) {
+			const auto pos = src.find_last_of('/', src.size() > 1 ? src.size() - 2 : 0);
+			auto name = (pos == std::string::npos ? src : src.substr(pos + 1));
+			if(!name.empty() && name.back() == '/') {
+				name.pop_back();
+			}
+			dst += "/" + name;
+		}
+	}
+
+	opt.chunk_size &= ~size_t(4095);
+
+	try {
+		std::vector<copy_job_t> jobs;
+		collect_jobs(src, dst, jobs);
+
+		uint64_t total_size = 0;
+		for(const auto& job : jobs) {
+			total_size += job.size;
+		}
+		std::cout << "Files: " << jobs.size() << ", " << total_size / pow(1024, 3) << " GiB" << std::endl;
+		std::cout << "Threads: " << opt.num_threads << ", Chunk: " << opt.chunk_size / 1024 << " KiB" << std::endl;
+
+		Throttle throttle(opt.limit_MBps);
+		std::atomic<uint64_t> progress {0};
+		std::atomic<bool> do_run {true};
+
+		std::thread reporter;
+		if(opt.progress) {
+			reporter = std::thread([&]() {
+				const auto time_begin = get_time_micros();
+				while(do_run) {
+					std::this_thread::sleep_for(std::chrono::milliseconds(500));
+					const auto elapsed = (get_time_micros() - time_begin) / 1e6;
+					const uint64_t bytes = progress;
+					std::cerr << "\rCopied " << bytes / pow(1024, 2) << " / " << total_size / pow(1024, 2) << " MiB ("
+							<< int(total_size ? 100 * bytes / total_size : 100) << " %), "
+							<< bytes / elapsed / pow(1024, 2) << " MiB/s      " << std::flush;
+				}
+				std::cerr << std::endl;
+			});
+		}
+
+		std::vector<std::vector<uint64_t>> checksums;
+
+		const auto time_begin = get_time_micros();
+		for(const auto& job : jobs) {
+			checksums.push_back(copy_file(job, opt, throttle, progress));
+		}
+		const auto time_end = get_time_micros();
+
+		do_run = false;
+		if(reporter.joinable()) {
+			reporter.join();
+		}
+		const auto elapsed = (time_end - time_begin) / 1e6;
+		std::cout << "Took " << elapsed << " sec, " << total_size / elapsed / pow(1024, 2) << " MiB/s" << std::endl;
+
+		if(opt.verify) {
+			bool passed = true;
+			uint64_t checksum = 0;
+			for(size_t i = 0; i < jobs.size(); ++i) {
+				passed = verify_file(jobs[i], opt, checksums[i]) && passed;
+				const auto& list = checksums[i];
+				checksum ^= hash_chunk((const uint8_t*)list.data(), list.size() * 8) + i;
+			}
+			if(!passed) {
+				std::cerr << "Verify failed" << std::endl;
+				return 1;
+			}
+			std::cout << "Verify passed (checksum " << std::hex << checksum << std::dec << ")" << std::endl;
+		}
+
+		if(opt.compare_cp) {
+			const std::string tmp = dst + ".cp_compare";
+			// include sync, since cp returns as soon as the data is in the page cache
+			const auto time_begin = get_time_micros();
+			const int ret = run_command({"cp", "-r", "--", src, tmp});
+			::sync();
+			const auto time_end = get_time_micros();
+			run_command({"rm", "-rf", "--", tmp});
+
+			if(ret != 0) {
+				std::cerr << "cp failed with status " << ret << std::endl;
+			} else {
+				const auto elapsed_cp = (time_end - time_begin) / 1e6;
+				std::cout << "cp + sync took " << elapsed_cp << " sec, " << total_size / elapsed_cp / pow(1024, 2) << " MiB/s"
+						<< " (dio_copy speedup " << elapsed_cp / elapsed << "x)" << std::endl;
+			}
+		}
+	} catch(const std::exception& ex) {
+		std::cerr << "ERROR: " << ex.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
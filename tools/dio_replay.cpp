@@ -0,0 +1,185 @@
+/*
+ * dio_replay.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: mad
+ */
+
+#include <mad/DirectFile.h>
+#include <mad/IOTrace.h>
+
+#include <cmath>
+#include <cstdio>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <getopt.h>
+
+inline
+int64_t get_time_micros() {
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static
+void print_usage()
+{
+	std::cerr << "Usage: dio_replay [options] <trace> <file>" << std::endl;
+	std::cerr << "  -s <factor>   speed up original timing by factor (default 1, 0 = as fast as possible)" << std::endl;
+	std::cerr << "  -p <log>      log_page_size (default 12)" << std::endl;
+	std::cerr << "  -b <KiB>      buffer_size (default 1024)" << std::endl;
+	std::cerr << "  -f <KiB>      auto_flush_bytes (default 4096)" << std::endl;
+	std::cerr << "  -r            open with read_flag (preserve existing content)" << std::endl;
+	std::cerr << "  -a            enable auto tuning" << std::endl;
+	std::cerr << "  -P            print write pattern profile" << std::endl;
+}
+
+
+int main(int argc, char** argv)
+{
+	double speed = 1;
+	int log_page_size = 12;
+	size_t buffer_size = 1024 * 1024;
+	size_t auto_flush_bytes = 4 * 1024 * 1024;
+	bool read_flag = false;
+	bool auto_tune = false;
+	bool profile = false;
+
+	int c = 0;
+	while((c = ::getopt(argc, argv, "s:p:b:f:raPh")) != -1)
+	{
+		switch(c) {
+			case 's': speed = atof(optarg); break;
+			case 'p': log_page_size = atoi(optarg); break;
+			case 'b': buffer_size = size_t(atoll(optarg)) * 1024; break;
+			case 'f': auto_flush_bytes = size_t(atoll(optarg)) * 1024; break;
+			case 'r': read_flag = true; break;
+			case 'a': auto_tune = true; break;
+			case 'P': profile = true; break;
+			default:
+				print_usage();
+				return -1;
+		}
+	}
+	if(argc - optind != 2) {
+		print_usage();
+		return -1;
+	}
+	const std::string trace_path(argv[optind]);
+	const std::string path(argv[optind + 1]);
+
+	try {
+		uint64_t num_dropped = 0;
+		const auto records = mad::IOTrace::load(trace_path, &num_dropped);
+
+		// split by original thread, each keeps its own order
+		uint64_t num_ops = 0;
+		uint64_t total_bytes = 0;
+		uint64_t max_length = 0;
+		std::vector<std::vector<mad::IOTrace::record_t>> streams;
+		for(const auto& entry : records) {
+			if(entry.op != mad::IOTrace::OP_WRITE && entry.op != mad::IOTrace::OP_FLUSH) {
+				continue;	// internal event
+			}
+			if(entry.thread >= streams.size()) {
+				streams.resize(entry.thread + 1);
+			}
+			streams[entry.thread].push_back(entry);
+			num_ops++;
+			if(entry.op == mad::IOTrace::OP_WRITE) {
+				total_bytes += entry.length;
+				max_length = std::max(max_length, entry.length);
+			}
+		}
+		std::cout << "Trace: " << num_ops << " ops, " << streams.size() << " threads, "
+				<< total_bytes / pow(1024, 3) << " GiB written" << std::endl;
+		if(num_dropped) {
+			std::cerr << "WARNING: " << num_dropped << " records were dropped while tracing (ring overflow), "
+					"replay is incomplete" << std::endl;
+		}
+
+		std::vector<uint8_t> data(max_length);
+		{
+			std::default_random_engine generator;
+			for(auto& v : data) {
+				v = generator();
+			}
+		}
+		::remove(path.c_str());
+
+		mad::DirectFile::stats_t stats;
+		std::vector<int64_t> total_lag(streams.size());
+
+		const auto time_begin = get_time_micros();
+		{
+			mad::DirectFile file(path, read_flag, true, true, log_page_size, buffer_size);
+			file.auto_flush_bytes = auto_flush_bytes;
+			if(auto_tune) {
+				file.enable_auto_tune();
+			}
+			mad::WriteProfiler profiler;
+			if(profile) {
+				file.profiler = &profiler;
+			}
+			std::cout << "Direct IO: " << (file.is_direct() ? "yes" : "no") << std::endl;
+
+			std::vector<std::thread> threads;
+			for(size_t i = 0; i < streams.size(); ++i)
+			{
+				threads.emplace_back([&, i]()
+				{
+					mad::DirectFile::buffer_t buffer;
+
+					for(const auto& entry : streams[i])
+					{
+						if(speed > 0) {
+							const auto deadline = time_begin + int64_t(entry.time / 1e3 / speed);
+							const auto now = get_time_micros();
+							if(deadline > now) {
+								std::this_thread::sleep_for(std::chrono::microseconds(deadline - now));
+							} else {
+								total_lag[i] += now - deadline;
+							}
+						}
+						switch(entry.op) {
+							case mad::IOTrace::OP_WRITE:
+								file.write(data.data(), entry.length, entry.offset, buffer);
+								break;
+							case mad::IOTrace::OP_FLUSH:
+								file.flush();
+								break;
+						}
+					}
+				});
+			}
+			for(auto& thread : threads) {
+				thread.join();
+			}
+			file.close();
+
+			stats = file.get_stats();
+		}
+		const auto time_end = get_time_micros();
+
+		int64_t lag = 0;
+		for(const auto value : total_lag) {
+			lag += value;
+		}
+		const auto elapsed = (time_end - time_begin) / 1e6;
+		std::cout << "Took " << elapsed << " sec, " << total_bytes / elapsed / pow(1024, 2) << " MiB/s" << std::endl;
+		if(speed > 0 && num_ops) {
+			std::cout << "Average lag behind schedule: " << lag / double(num_ops) << " usec" << std::endl;
+		}
+		std::cout << "Syscalls: " << stats.num_syscalls() << " (pwrite " << stats.num_pwrite
+				<< ", flush " << stats.num_pwrite_flush << ", pread " << stats.num_pread << ")" << std::endl;
+		std::cout << "Lock wait: " << stats.lock_wait_ns / 1e6 << " ms (" << stats.num_lock_wait << " times)" << std::endl;
+	}
+	catch(const std::exception& ex) {
+		std::cerr << "ERROR: " << ex.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
+